@@ -0,0 +1,99 @@
+# Encodes a batch of 10k sampled traces and compares throughput and peak
+# RSS between gzipping the encoded batch with Util::Gzip, as Util::HTTP
+# does, and streaming it through deflate while encoding.
+#
+# Run with `rake bench` (or `ruby -I<path to skylight_native> -Ilib bench/batch_gzip.rb`).
+
+require 'stringio'
+require 'skylight_native'
+require 'skylight/util/gzip'
+
+TRACES    = (ENV['TRACES'] || 10_000).to_i
+SPANS     = (ENV['SPANS'] || 20).to_i
+LEVEL     = (ENV['LEVEL'] || 6).to_i
+ENDPOINTS = 50
+
+def build_batch
+  counter = Skylight::EndpointCounter.native_new
+  sample  = Skylight::Reservoir.native_new(TRACES, false)
+
+  TRACES.times do |i|
+    trace = Skylight::Trace.native_new(0, "uuid-#{i}")
+    trace.native_set_name("Controller#action#{i % ENDPOINTS}")
+
+    root = trace.native_start_span(0, "app.rack.request")
+
+    SPANS.times do |j|
+      span = trace.native_start_span(j * 10, "db.sql.query")
+      trace.native_span_set_title(span, "SELECT FROM users")
+      trace.native_span_set_description(span, "SELECT * FROM users WHERE id = ? AND account_id = ? LIMIT ?")
+      trace.native_stop_span(span, j * 10 + 5)
+    end
+
+    trace.native_stop_span(root, SPANS * 10)
+
+    serialized = trace.native_serialize
+    counter.native_push(serialized)
+    sample.native_push(serialized)
+  end
+
+  [counter, sample]
+end
+
+# Resets the high water mark of the process' RSS, where supported
+def reset_peak_rss
+  File.write("/proc/self/clear_refs", "5")
+  true
+rescue SystemCallError, IOError
+  false
+end
+
+def proc_status(key)
+  File.read("/proc/self/status")[/^#{key}:\s+(\d+) kB/, 1].to_i * 1024
+rescue SystemCallError, IOError
+  0
+end
+
+def run(name)
+  rd, wr = IO.pipe
+
+  pid = fork do
+    rd.close
+
+    counter, sample = build_batch
+    raw_size = Skylight::Batch.native_encode(0, "localhost", counter, sample).bytesize
+
+    GC.start
+    GC.disable
+
+    reset_peak_rss
+    rss = proc_status("VmRSS")
+
+    started = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+    body    = yield(counter, sample)
+    elapsed = Process.clock_gettime(Process::CLOCK_MONOTONIC) - started
+
+    peak = proc_status("VmHWM") - rss
+
+    wr.write [raw_size, body.bytesize, elapsed, peak].join(" ")
+    wr.close
+    exit!
+  end
+
+  wr.close
+  raw_size, size, elapsed, peak = rd.read.split(" ").map(&:to_f)
+  Process.wait(pid)
+
+  printf "%-8s raw %6.1f MB  gzipped %6.1f MB  %7.1f MB/s  peak RSS +%6.1f MB\n",
+    name, raw_size / 1_048_576, size / 1_048_576, raw_size / elapsed / 1_048_576, peak / 1_048_576
+end
+
+puts "#{TRACES} traces of #{SPANS} spans, level #{LEVEL}"
+
+run("ruby") do |counter, sample|
+  Skylight::Util::Gzip.compress(Skylight::Batch.native_encode(0, "localhost", counter, sample), LEVEL)
+end
+
+run("native") do |counter, sample|
+  Skylight::Batch.native_encode(0, "localhost", counter, sample, LEVEL)
+end
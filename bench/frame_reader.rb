@@ -0,0 +1,136 @@
+# Feeds framed messages through a socketpair from a child process at a fixed
+# rate and compares the reader's CPU time and Ruby allocations when decoding
+# with the previous String buffer logic against Skylight::FrameReader.
+#
+# Run with `rake bench` (or `ruby -I<path to skylight_native> bench/frame_reader.rb`).
+
+require 'socket'
+require 'skylight_native'
+
+RATE     = (ENV['RATE'] || 50_000).to_i
+SECONDS  = (ENV['SECONDS'] || 3).to_f
+PAYLOAD  = (ENV['PAYLOAD'] || 600).to_i
+MESSAGES = (RATE * SECONDS).to_i
+
+FRAME = ([0, PAYLOAD].pack("LL") + ("x" * PAYLOAD)).freeze
+
+# The decoding Worker::Connection did before FrameReader
+class StringFrames
+  FRAME_HDR_LEN = 8
+
+  def initialize(sock)
+    @sock = sock
+    @buf  = ""
+    @len  = nil
+  end
+
+  def read
+    if msg = maybe_read_message
+      return msg
+    end
+
+    if chunk = read_sock
+      @buf << chunk
+      @len = @buf[4, 4].unpack("L")[0] if !@len && @buf.bytesize >= FRAME_HDR_LEN
+      maybe_read_message
+    end
+  end
+
+  def maybe_read_message
+    if @len && @buf.bytesize >= @len + FRAME_HDR_LEN
+      @buf[0, 4].unpack("L")[0]
+      data = @buf[FRAME_HDR_LEN, @len]
+      @buf = @buf[(FRAME_HDR_LEN + @len)..-1] || ""
+      @len = @buf.bytesize >= FRAME_HDR_LEN ? @buf[4, 4].unpack("L")[0] : nil
+      data
+    end
+  end
+
+  def read_sock
+    @sock.read_nonblock(16 * 1024)
+  rescue Errno::EAGAIN, Errno::EWOULDBLOCK
+  end
+end
+
+class NativeFrames
+  def initialize(sock)
+    @sock   = sock
+    @reader = Skylight::FrameReader.native_new
+    @frames = []
+  end
+
+  def read
+    @reader.native_read(@sock.fileno, @frames) if @frames.empty?
+    return if @frames.empty?
+    @frames.shift
+    @frames.shift
+  end
+end
+
+def produce(sock)
+  # Write in bursts every millisecond to hold the requested rate
+  per_tick = [RATE / 1000, 1].max
+  burst    = FRAME * per_tick
+  start    = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+  sent     = 0
+
+  while sent < MESSAGES
+    sock.write(burst)
+    sent += per_tick
+
+    ahead = sent.to_f / RATE - (Process.clock_gettime(Process::CLOCK_MONOTONIC) - start)
+    sleep ahead if ahead > 0
+  end
+ensure
+  sock.close
+end
+
+def cpu_time
+  Process.clock_gettime(Process::CLOCK_PROCESS_CPUTIME_ID)
+end
+
+def allocated
+  GC.stat[:total_allocated_objects] rescue 0
+end
+
+def run(name, klass)
+  reader, writer = UNIXSocket.pair
+
+  pid = fork do
+    reader.close
+    produce(writer)
+    exit!
+  end
+
+  writer.close
+
+  frames  = klass.new(reader)
+  count   = 0
+  cpu     = cpu_time
+  objects = allocated
+  started = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+
+  begin
+    while true
+      IO.select([reader])
+      count += 1 while frames.read
+    end
+  rescue EOFError
+  end
+
+  elapsed = Process.clock_gettime(Process::CLOCK_MONOTONIC) - started
+  cpu     = cpu_time - cpu
+  objects = allocated - objects
+
+  Process.wait(pid)
+
+  printf "%-8s %8d msgs  %8.0f msgs/s  cpu %6.3fs (%5.2f us/msg)  %5.1f objects/msg\n",
+    name, count, count / elapsed, cpu, cpu * 1_000_000 / count, objects.to_f / count
+ensure
+  reader.close rescue nil
+end
+
+puts "#{MESSAGES} frames of #{PAYLOAD} bytes at #{RATE} msgs/s"
+
+run("string", StringFrames)
+run("native", NativeFrames)
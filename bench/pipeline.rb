@@ -0,0 +1,188 @@
+# Measures the agent's hot paths end to end, from building a trace in the
+# app process to the worker's collector:
+#
+# * trace lifecycle: Trace.native_new, N spans, native_serialize
+# * Batch.native_encode of 100 to 10k sampled traces
+# * Trace.native_name_from_serialized, as the collector calls it per trace
+# * traces per second through Standalone#handle, the IPC socket,
+#   Connection#read and Collector#handle
+#
+# Results are printed as a table, or as JSON lines, one object per
+# measurement, with FORMAT=json, so runs can be compared across agent
+# versions. OUTPUT names a file to also write the JSON lines to.
+#
+# Run with `rake bench` (or `ruby -I<path to skylight_native> -Ilib bench/pipeline.rb`).
+
+require 'json'
+require 'socket'
+require 'skylight'
+
+SECONDS = (ENV['SECONDS'] || 1).to_f
+FORMAT  = ENV['FORMAT'] || 'table'
+OUTPUT  = ENV['OUTPUT']
+
+CATEGORY    = "db.sql.query".freeze
+TITLE       = "SELECT FROM users".freeze
+DESCRIPTION = "SELECT * FROM users WHERE id = ? AND account_id = ? LIMIT ?".freeze
+
+RESULTS = []
+
+def now
+  Process.clock_gettime(Process::CLOCK_MONOTONIC)
+end
+
+def allocated
+  GC.stat[:total_allocated_objects] rescue 0
+end
+
+# Runs the block, which performs `ops` operations, for about SECONDS and
+# records the time and Ruby allocations per operation
+def measure(name, params = {}, ops = 1)
+  yield # warm up
+
+  iterations = 0
+  objects    = allocated
+  started    = now
+
+  begin
+    yield
+    iterations += 1
+  end while now - started < SECONDS
+
+  record(name, params, iterations * ops, now - started, allocated - objects)
+end
+
+def record(name, params, ops, elapsed, objects)
+  result = {
+    "name"           => name,
+    "params"         => params,
+    "ops"            => ops,
+    "seconds"        => elapsed.round(6),
+    "us_per_op"      => (elapsed * 1_000_000 / ops).round(3),
+    "ops_per_sec"    => (ops / elapsed).round(1),
+    "objects_per_op" => objects && (objects.to_f / ops).round(2)
+  }
+
+  RESULTS << result
+
+  if FORMAT == 'json'
+    puts JSON.generate(result)
+  else
+    printf "%-16s %-12s %12.1f ops/s %10.2f us/op %10s objects/op\n",
+      name, params.map { |k, v| "#{k}=#{v}" }.join(" "),
+      result["ops_per_sec"], result["us_per_op"], result["objects_per_op"] || "-"
+  end
+end
+
+def build_trace(spans, i = 0)
+  trace = Skylight::Trace.native_new(0, "uuid-#{i}")
+  trace.native_set_name("Controller#action#{i % 50}")
+
+  root = trace.native_start_span(0, "app.rack.request")
+
+  spans.times do |j|
+    sp = trace.native_start_span(j * 10, CATEGORY)
+    trace.native_span_set_title(sp, TITLE)
+    trace.native_span_set_description(sp, DESCRIPTION)
+    trace.native_stop_span(sp, j * 10 + 5)
+  end
+
+  trace.native_stop_span(root, spans * 10)
+  trace
+end
+
+def bench_trace_lifecycle
+  [1, 10, 100, 1000].each do |spans|
+    measure("trace.lifecycle", spans: spans) { build_trace(spans).native_serialize }
+  end
+end
+
+def bench_batch_encode
+  [100, 1_000, 10_000].each do |traces|
+    counter = Skylight::EndpointCounter.native_new
+    sample  = Skylight::Reservoir.native_new(traces, false)
+
+    traces.times do |i|
+      serialized = build_trace(20, i).native_serialize
+      counter.native_push(serialized)
+      sample.native_push(serialized)
+    end
+
+    measure("batch.encode", traces: traces) do
+      Skylight::Batch.native_encode(0, "localhost", counter, sample)
+    end
+  end
+end
+
+def bench_name_from_serialized
+  serialized = Array.new(100) { |i| build_trace(20, i).native_serialize }
+
+  measure("trace.name", {}, serialized.length) do
+    serialized.each { |s| Skylight::Trace.native_name_from_serialized(s) }
+  end
+end
+
+# The app process writes traces through Standalone; a forked worker reads
+# them with Connection and hands them to a Collector that never reports.
+def bench_ipc(traces, spans)
+  config = Skylight::Config.new(agent: { sockfile_path: "/tmp" })
+  app, worker = UNIXSocket.pair
+
+  rd, wr = IO.pipe
+
+  pid = fork do
+    app.close
+    rd.close
+
+    conn = Skylight::Worker::Connection.new(worker)
+    collector = Skylight::Worker::Collector.new(config, Skylight::Worker::MetricsReporter.new(config))
+
+    def collector.should_refresh_token?(now); false; end
+    def collector.has_report_token?(now); false; end
+
+    received = 0
+    started  = nil
+
+    while received < traces
+      if msg = conn.read
+        started ||= now
+        collector.handle(msg)
+        received += 1
+      else
+        IO.select([worker])
+      end
+    end
+
+    wr.write((now - started).to_s)
+    wr.close
+    exit!
+  end
+
+  worker.close
+  wr.close
+
+  standalone = Skylight::Worker::Standalone.new(config, "lockfile", "server")
+  standalone.instance_variable_set(:@sock, app)
+
+  # Traces are consumed by serialization, so each is built and sent once.
+  # They are handled as the writer thread would handle them.
+  msgs = Array.new(traces) { |i| build_trace(spans, i) }
+  msgs.each { |msg| standalone.send(:handle, msg) }
+  standalone.send(:flush)
+
+  elapsed = rd.read.to_f
+  Process.wait(pid)
+  app.close
+
+  # Timed from the first trace received
+  record("ipc.pipeline", { spans: spans }, traces - 1, elapsed, nil)
+end
+
+bench_trace_lifecycle
+bench_batch_encode
+bench_name_from_serialized
+bench_ipc((ENV['TRACES'] || 20_000).to_i, 20)
+
+if OUTPUT
+  File.write(OUTPUT, RESULTS.map { |r| JSON.generate(r) + "\n" }.join)
+end
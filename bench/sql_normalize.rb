@@ -0,0 +1,59 @@
+# Runs a corpus of ActiveRecord queries, as sql.active_record payloads,
+# through Normalizers::SQL and compares the time and Ruby allocations per
+# query when lexing every query against caching the lexed queries.
+#
+# Run with `rake bench` (or `ruby -I<path to skylight_native> -Ilib bench/sql_normalize.rb`).
+
+require 'skylight'
+
+ITERATIONS = (ENV['ITERATIONS'] || 20_000).to_i
+
+# Queries as Rails 4 issues them against PostgreSQL and MySQL; the latter
+# with the binds inlined, so that some queries never repeat
+CORPUS = [
+  [%{SELECT  "users".* FROM "users"  WHERE "users"."id" = $1 LIMIT 1}, 1],
+  [%{SELECT  "accounts".* FROM "accounts"  WHERE "accounts"."id" = $1 LIMIT 1}, 1],
+  [%{SELECT "posts".* FROM "posts"  WHERE "posts"."user_id" = $1  ORDER BY "posts"."created_at" DESC}, 1],
+  [%{SELECT COUNT(*) FROM "comments"  WHERE "comments"."post_id" = $1}, 1],
+  [%{SELECT "tags".* FROM "tags" INNER JOIN "taggings" ON "tags"."id" = "taggings"."tag_id" WHERE "taggings"."taggable_id" = $1 AND "taggings"."taggable_type" = $2}, 2],
+  [%{UPDATE "users" SET "last_seen_at" = $1, "updated_at" = $2 WHERE "users"."id" = 1}, 2],
+  [%{INSERT INTO "events" ("name", "payload", "created_at", "updated_at") VALUES ($1, $2, $3, $4) RETURNING "id"}, 4],
+  [%{SELECT "projects".* FROM "projects"  WHERE "projects"."account_id" IN (1, 2, 3, 4, 5) AND "projects"."archived" = 'f'}, 0],
+  [%{DELETE FROM "sessions" WHERE "sessions"."updated_at" < $1}, 1],
+  [%{SELECT  `users`.* FROM `users`  WHERE `users`.`email` = 'user%d@example.com' LIMIT 1}, 0],
+  [%{SELECT `orders`.* FROM `orders`  WHERE `orders`.`customer_id` = %d AND `orders`.`state` IN ('paid', 'shipped')}, 0],
+  [%{SELECT "notifications".* FROM "notifications"  WHERE "notifications"."user_id" = $1 AND "notifications"."read_at" IS NULL  ORDER BY "notifications"."id" DESC LIMIT 20 OFFSET 0}, 1],
+].freeze
+
+PAYLOADS = Array.new(ITERATIONS) do |i|
+  sql, binds = CORPUS[i % CORPUS.length]
+  sql = sql % (i % 500) if sql.include?("%d")
+  { name: "Load", sql: sql.dup.freeze, binds: Array.new(binds) { |b| [nil, i + b] } }
+end.freeze
+
+def allocated
+  GC.stat[:total_allocated_objects] rescue 0
+end
+
+def run(name, cache_size)
+  config = Skylight::Config.new(normalizers: { sql: { cache_size: cache_size } })
+  normalizers = Skylight::Normalizers.build(config)
+
+  PAYLOADS.first(CORPUS.length).each { |payload| normalizers.normalize(nil, "sql.active_record", payload) }
+
+  objects = allocated
+  started = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+
+  PAYLOADS.each { |payload| normalizers.normalize(nil, "sql.active_record", payload) }
+
+  elapsed = Process.clock_gettime(Process::CLOCK_MONOTONIC) - started
+  objects = allocated - objects
+
+  printf "%-8s %8.0f queries/s  %7.2f us/query  %6.1f objects/query\n",
+    name, ITERATIONS / elapsed, elapsed * 1_000_000 / ITERATIONS, objects.to_f / ITERATIONS
+end
+
+puts "#{ITERATIONS} queries, #{CORPUS.length} statements"
+
+run("lexed", 0)
+run("cached", 1000)
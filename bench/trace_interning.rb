@@ -0,0 +1,54 @@
+# Compares building a 500 span trace with category and title strings against
+# passing interned ids, reporting time and Ruby allocations per trace.
+#
+# Run with `rake bench` (or `ruby -I<path to skylight_native> bench/trace_interning.rb`).
+
+require 'benchmark'
+require 'skylight_native'
+
+SPANS      = (ENV['SPANS'] || 500).to_i
+ITERATIONS = (ENV['ITERATIONS'] || 200).to_i
+
+CATEGORIES = %w(db.sql.query view.render.template view.render.collection noise.gc).map(&:freeze)
+TITLES     = %w(SELECT\ FROM\ users users/index.html.erb users/_user.html.erb).map(&:freeze)
+
+def build(categories, titles)
+  trace = Skylight::Trace.native_new(0, "bench")
+  root = trace.native_record_spans([0, nil, categories[0], nil, nil])
+  records = []
+
+  SPANS.times do |i|
+    # Dup the strings as a normalizer would produce them
+    cat   = categories[i % categories.length]
+    title = titles[i % titles.length]
+    cat   = cat.dup   if String === cat
+    title = title.dup if String === title
+
+    records.push(i, i, cat, title, nil)
+  end
+
+  trace.native_record_spans(records)
+  trace.native_stop_span(root, SPANS)
+  trace.native_serialize
+end
+
+def allocations
+  before = GC.stat[:total_allocated_objects]
+  yield
+  GC.stat[:total_allocated_objects] - before
+end
+
+interned_categories = CATEGORIES.map { |c| Skylight::Trace.native_intern(c) }
+interned_titles     = TITLES.map { |t| Skylight::Trace.native_intern(t) }
+
+puts "#{ITERATIONS} traces x #{SPANS} spans"
+
+if GC.respond_to?(:stat) && GC.stat.key?(:total_allocated_objects)
+  puts "allocations per trace (strings):  #{allocations { build(CATEGORIES, TITLES) }}"
+  puts "allocations per trace (interned): #{allocations { build(interned_categories, interned_titles) }}"
+end
+
+Benchmark.bmbm do |x|
+  x.report("strings")  { ITERATIONS.times { build(CATEGORIES, TITLES) } }
+  x.report("interned") { ITERATIONS.times { build(interned_categories, interned_titles) } }
+end
@@ -0,0 +1,50 @@
+# Compares recording spans with one native call per operation against
+# batching them through Trace#native_record_spans.
+#
+# Run with `rake bench` (or `ruby -I<path to skylight_native> bench/trace_spans.rb`).
+
+require 'benchmark'
+require 'skylight_native'
+
+SPANS      = (ENV['SPANS'] || 500).to_i
+ITERATIONS = (ENV['ITERATIONS'] || 200).to_i
+
+CATEGORY    = "db.sql.query".freeze
+TITLE       = "SELECT FROM users".freeze
+DESCRIPTION = "SELECT * FROM users WHERE id = ?".freeze
+
+def per_call
+  trace = Skylight::Trace.native_new(0, "bench")
+  root = trace.native_start_span(0, "app.rack.request")
+
+  SPANS.times do |i|
+    sp = trace.native_start_span(i, CATEGORY)
+    trace.native_span_set_title(sp, TITLE)
+    trace.native_span_set_description(sp, DESCRIPTION)
+    trace.native_stop_span(sp, i)
+  end
+
+  trace.native_stop_span(root, SPANS)
+  trace.native_serialize
+end
+
+def batched
+  trace = Skylight::Trace.native_new(0, "bench")
+  root = trace.native_record_spans([0, nil, "app.rack.request", nil, nil])
+  records = []
+
+  SPANS.times do |i|
+    records.push(i, i, CATEGORY, TITLE, DESCRIPTION)
+  end
+
+  trace.native_record_spans(records)
+  trace.native_stop_span(root, SPANS)
+  trace.native_serialize
+end
+
+puts "#{ITERATIONS} traces x #{SPANS} spans"
+
+Benchmark.bmbm do |x|
+  x.report("per-call") { ITERATIONS.times { per_call } }
+  x.report("batched")  { ITERATIONS.times { batched } }
+end
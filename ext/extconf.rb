@@ -103,6 +103,22 @@ end
 #
 
 have_header 'dlfcn.h'
+have_header 'ruby/thread.h'
+have_func 'rb_thread_call_without_gvl', 'ruby/thread.h'
+
+# GC time is tracked through the internal GC events where the tracepoint
+# API exposes them, and through GC::Profiler otherwise
+have_header 'ruby/debug.h'
+have_func 'rb_tracepoint_new', 'ruby/debug.h'
+
+# The worker waits on its sockets with epoll where it can, and IO.select
+# otherwise
+have_header 'sys/epoll.h'
+have_header 'sys/timerfd.h'
+
+# Batches are gzipped natively when zlib is around, and by Ruby otherwise.
+# The header is only looked for, and HAVE_ZLIB_H defined, once libz links.
+have_library('z', 'deflateInit2_', 'zlib.h') && have_header('zlib.h')
 
 find_header("rust_support/ruby.h", ".") or fail "could not find rust support header"
 find_library("skylight", "factory", ".") or fail "could not find skylight library"
@@ -0,0 +1,666 @@
+#include <stdlib.h>
+#include <string.h>
+#include <skylight_native.h>
+#include <skylight_protobuf.h>
+
+#ifdef HAVE_RUBY_ENCODING_H
+#include <ruby/encoding.h>
+#endif
+
+#define TRACE_ENDPOINT 2
+#define TRACE_SPANS    3
+#define SPAN_EVENT     2
+#define SPAN_DURATION  5
+
+#define EVENT_CATEGORY 1
+#define EVENT_TITLE    2
+
+#define HISTOGRAM_PRECISION 1
+#define HISTOGRAM_BUCKETS   2
+#define HISTOGRAM_COUNTS    3
+
+/**
+ * Endpoint table
+ */
+
+void sk_endpoints_init(sk_endpoints_t* endpoints, int precision) {
+  memset(endpoints, 0, sizeof(sk_endpoints_t));
+  endpoints->precision = precision;
+}
+
+void sk_endpoints_destroy(sk_endpoints_t* endpoints) {
+  long i;
+  sk_endpoint_t* entry;
+
+  for (i = 0; i < endpoints->len; ++i) {
+    entry = &endpoints->entries[i];
+
+    free(entry->name);
+    free(entry->histogram);
+
+    if (entry->rollups) {
+      sk_endpoints_destroy(entry->rollups);
+      free(entry->rollups);
+    }
+  }
+
+  free(endpoints->entries);
+  free(endpoints->buckets);
+  free(endpoints->key);
+
+  sk_endpoints_init(endpoints, endpoints->precision);
+}
+
+/* Buckets hold the entry index + 1 so that zeroed buckets are empty */
+static void endpoints_index(sk_endpoints_t* endpoints, long* buckets, long nbuckets, long i) {
+  long bucket = endpoints->entries[i].hash & (nbuckets - 1);
+
+  while (buckets[bucket]) {
+    bucket = (bucket + 1) & (nbuckets - 1);
+  }
+
+  buckets[bucket] = i + 1;
+}
+
+static bool endpoints_reserve(sk_endpoints_t* endpoints) {
+  long i, capa, nbuckets;
+  long* buckets;
+  sk_endpoint_t* entries;
+
+  if (endpoints->len == endpoints->capa) {
+    capa = endpoints->capa ? endpoints->capa * 2 : 16;
+    entries = realloc(endpoints->entries, capa * sizeof(sk_endpoint_t));
+
+    if (!entries) {
+      return false;
+    }
+
+    endpoints->entries = entries;
+    endpoints->capa = capa;
+  }
+
+  /* Keep the index at most half full */
+  if ((endpoints->len + 1) * 2 > endpoints->nbuckets) {
+    nbuckets = endpoints->nbuckets ? endpoints->nbuckets * 2 : 32;
+    buckets = calloc(nbuckets, sizeof(long));
+
+    if (!buckets) {
+      return false;
+    }
+
+    for (i = 0; i < endpoints->len; ++i) {
+      endpoints_index(endpoints, buckets, nbuckets, i);
+    }
+
+    free(endpoints->buckets);
+    endpoints->buckets = buckets;
+    endpoints->nbuckets = nbuckets;
+  }
+
+  return true;
+}
+
+long sk_endpoints_lookup(sk_endpoints_t* endpoints, const char* name, size_t len, bool create) {
+  long i, bucket;
+  uint32_t hash = sk_hash(name, len);
+  sk_endpoint_t* entry;
+
+  if (endpoints->nbuckets) {
+    bucket = hash & (endpoints->nbuckets - 1);
+
+    while ((i = endpoints->buckets[bucket] - 1) >= 0) {
+      entry = &endpoints->entries[i];
+
+      if (entry->hash == hash && entry->len == len && memcmp(entry->name, name, len) == 0) {
+        return i;
+      }
+
+      bucket = (bucket + 1) & (endpoints->nbuckets - 1);
+    }
+  }
+
+  if (!create) {
+    return SK_ENDPOINTS_MISSING;
+  }
+
+  if (!endpoints_reserve(endpoints)) {
+    return SK_ENDPOINTS_NOMEM;
+  }
+
+  i = endpoints->len;
+  entry = &endpoints->entries[i];
+
+  if (!(entry->name = malloc(len ? len : 1))) {
+    return SK_ENDPOINTS_NOMEM;
+  }
+
+  memcpy(entry->name, name, len);
+  entry->len = len;
+  entry->hash = hash;
+  entry->count = 0;
+  entry->total = 0;
+  entry->max = 0;
+  entry->histogram = NULL;
+  entry->rollups = NULL;
+
+  endpoints->len++;
+  endpoints_index(endpoints, endpoints->buckets, endpoints->nbuckets, i);
+
+  return i;
+}
+
+bool sk_trace_endpoint_name(const void* trace, size_t len, const char** name, size_t* name_len) {
+  const uint8_t* data;
+
+  if (!pb_find_bytes(trace, len, TRACE_ENDPOINT, &data, name_len)) {
+    return false;
+  }
+
+  *name = (const char*) data;
+  return true;
+}
+
+bool sk_trace_duration(const void* trace, size_t len, uint64_t* duration) {
+  const uint8_t* span;
+  size_t span_len;
+
+  /* The root span comes first */
+  if (!pb_find_bytes(trace, len, TRACE_SPANS, &span, &span_len)) {
+    return false;
+  }
+
+  return pb_find_uint(span, span_len, SPAN_DURATION, duration);
+}
+
+/**
+ * Histograms
+ *
+ * With a precision of p, durations below 2^p get a bucket each. Above that,
+ * a duration with its highest bit at position e lands in one of the 2^p
+ * buckets splitting [2^e, 2^(e+1)), chosen by the p bits below the highest
+ * one.
+ */
+
+static long histogram_bucket(uint64_t val, int precision) {
+  int e;
+
+  if (val > UINT32_MAX) {
+    val = UINT32_MAX;
+  }
+
+  if (val < (1u << precision)) {
+    return (long) val;
+  }
+
+  e = 63 - __builtin_clzll(val);
+
+  return ((long) (e - precision + 1) << precision) +
+    (long) ((val >> (e - precision)) & ((1u << precision) - 1));
+}
+
+/* Smallest duration that lands in the bucket */
+static uint64_t histogram_bucket_min(long bucket, int precision) {
+  long e = (bucket >> precision) + precision - 1;
+  uint64_t sub = bucket & ((1u << precision) - 1);
+
+  if (bucket < (1 << precision)) {
+    return (uint64_t) bucket;
+  }
+
+  return ((uint64_t) (1u << precision) + sub) << (e - precision);
+}
+
+static bool histogram_record(sk_endpoints_t* endpoints, sk_endpoint_t* entry, uint64_t duration) {
+  if (!entry->histogram) {
+    if (!(entry->histogram = calloc(SK_HISTOGRAM_BUCKETS(endpoints->precision), sizeof(uint32_t)))) {
+      return false;
+    }
+  }
+
+  entry->histogram[histogram_bucket(duration, endpoints->precision)]++;
+  entry->total += duration;
+
+  if (duration > entry->max) {
+    entry->max = duration;
+  }
+
+  return true;
+}
+
+/*
+ * The histogram is sent sparsely, as the indexes of the non-empty buckets
+ * and their counts, in two packed fields
+ */
+static size_t histogram_packed_sizes(sk_endpoints_t* endpoints, sk_endpoint_t* entry, size_t* buckets, size_t* counts) {
+  long i;
+
+  *buckets = 0;
+  *counts = 0;
+
+  for (i = 0; i < SK_HISTOGRAM_BUCKETS(endpoints->precision); ++i) {
+    if (entry->histogram[i]) {
+      *buckets += pb_varint_size(i);
+      *counts += pb_varint_size(entry->histogram[i]);
+    }
+  }
+
+  return pb_uint_size(HISTOGRAM_PRECISION, endpoints->precision) +
+    pb_bytes_size(HISTOGRAM_BUCKETS, *buckets) +
+    pb_bytes_size(HISTOGRAM_COUNTS, *counts);
+}
+
+size_t sk_histogram_size(sk_endpoints_t* endpoints, sk_endpoint_t* entry, int field) {
+  size_t buckets, counts;
+
+  if (!entry->histogram) {
+    return 0;
+  }
+
+  return pb_bytes_size(field, histogram_packed_sizes(endpoints, entry, &buckets, &counts));
+}
+
+void sk_histogram_write(sk_endpoints_t* endpoints, sk_endpoint_t* entry, int field, pb_writer_t* w) {
+  long i, nbuckets = SK_HISTOGRAM_BUCKETS(endpoints->precision);
+  size_t buckets, counts;
+
+  if (!entry->histogram) {
+    return;
+  }
+
+  pb_write_header(w, field, histogram_packed_sizes(endpoints, entry, &buckets, &counts));
+  pb_write_uint(w, HISTOGRAM_PRECISION, endpoints->precision);
+
+  pb_write_header(w, HISTOGRAM_BUCKETS, buckets);
+
+  for (i = 0; i < nbuckets; ++i) {
+    if (entry->histogram[i]) {
+      pb_write_varint(w, i);
+    }
+  }
+
+  pb_write_header(w, HISTOGRAM_COUNTS, counts);
+
+  for (i = 0; i < nbuckets; ++i) {
+    if (entry->histogram[i]) {
+      pb_write_varint(w, entry->histogram[i]);
+    }
+  }
+}
+
+/**
+ * Span rollups
+ */
+
+void sk_rollup_key(sk_endpoint_t* rollup, const char** category, size_t* category_len, const char** title, size_t* title_len) {
+  const char* sep = memchr(rollup->name, '\0', rollup->len);
+
+  *category = rollup->name;
+  *category_len = sep - rollup->name;
+  *title = sep + 1;
+  *title_len = rollup->len - *category_len - 1;
+}
+
+static long rollups_lookup(sk_endpoints_t* rollups, const uint8_t* category, size_t category_len, const uint8_t* title, size_t title_len) {
+  long i;
+  char* key;
+  size_t len = category_len + 1 + title_len;
+
+  if (len > rollups->key_capa) {
+    if (!(key = realloc(rollups->key, len))) {
+      return SK_ENDPOINTS_NOMEM;
+    }
+
+    rollups->key = key;
+    rollups->key_capa = len;
+  }
+
+  memcpy(rollups->key, category, category_len);
+  rollups->key[category_len] = '\0';
+  memcpy(rollups->key + category_len + 1, title, title_len);
+
+  i = sk_endpoints_lookup(rollups, rollups->key, len, rollups->len < SK_ROLLUPS_MAX);
+
+  /*
+   * Past the limit, new titles go under their category alone, as do new
+   * categories without a title. Those are always added.
+   */
+  if (i == SK_ENDPOINTS_MISSING) {
+    i = sk_endpoints_lookup(rollups, rollups->key, category_len + 1, true);
+  }
+
+  return i;
+}
+
+/* Returns false if memory could not be allocated */
+static bool rollup_span(sk_endpoints_t* rollups, const uint8_t* span, size_t span_len) {
+  long i;
+  const uint8_t* event;
+  const uint8_t* category;
+  const uint8_t* title;
+  size_t event_len, category_len, title_len;
+  uint64_t duration;
+
+  /* Spans still open when the trace was serialized have no duration */
+  if (!pb_find_uint(span, span_len, SPAN_DURATION, &duration) ||
+      !pb_find_bytes(span, span_len, SPAN_EVENT, &event, &event_len) ||
+      !pb_find_bytes(event, event_len, EVENT_CATEGORY, &category, &category_len)) {
+    return true;
+  }
+
+  if (!pb_find_bytes(event, event_len, EVENT_TITLE, &title, &title_len)) {
+    title_len = 0;
+  }
+
+  if ((i = rollups_lookup(rollups, category, category_len, title, title_len)) < 0) {
+    return false;
+  }
+
+  rollups->entries[i].count++;
+
+  return histogram_record(rollups, &rollups->entries[i], duration);
+}
+
+static bool rollup_trace(sk_endpoint_t* endpoint, const void* trace, size_t len) {
+  pb_reader_t r;
+  uint32_t field, type;
+  const uint8_t* span;
+  size_t span_len;
+
+  if (!endpoint->rollups) {
+    if (!(endpoint->rollups = malloc(sizeof(sk_endpoints_t)))) {
+      return false;
+    }
+
+    sk_endpoints_init(endpoint->rollups, SK_ROLLUP_SUB_BITS);
+  }
+
+  pb_reader_init(&r, trace, len);
+
+  while (r.pos < r.end && pb_read_tag(&r, &field, &type)) {
+    if (field == TRACE_SPANS && type == PB_BYTES) {
+      if (!pb_read_bytes(&r, &span, &span_len)) {
+        break;
+      }
+
+      if (!rollup_span(endpoint->rollups, span, span_len)) {
+        return false;
+      }
+    }
+    else if (!pb_skip(&r, type)) {
+      break;
+    }
+  }
+
+  return true;
+}
+
+/**
+ * Pushing and merging
+ */
+
+int sk_endpoints_push(sk_endpoints_t* endpoints, const void* trace, size_t len) {
+  long i;
+  const char* name;
+  size_t name_len;
+  uint64_t duration;
+  sk_endpoint_t* endpoint;
+
+  if (!sk_trace_endpoint_name(trace, len, &name, &name_len)) {
+    return 0;
+  }
+
+  if ((i = sk_endpoints_lookup(endpoints, name, name_len, true)) < 0) {
+    return -1;
+  }
+
+  endpoint = &endpoints->entries[i];
+  endpoint->count++;
+
+  if (sk_trace_duration(trace, len, &duration)) {
+    if (!histogram_record(endpoints, endpoint, duration)) {
+      return -1;
+    }
+  }
+
+  if (!rollup_trace(endpoint, trace, len)) {
+    return -1;
+  }
+
+  return 1;
+}
+
+static bool endpoints_merge(sk_endpoints_t* dst, sk_endpoints_t* src, bool rollups);
+
+static bool endpoint_merge(sk_endpoint_t* entry, sk_endpoint_t* from, int precision) {
+  long b;
+
+  entry->count += from->count;
+  entry->total += from->total;
+
+  if (from->max > entry->max) {
+    entry->max = from->max;
+  }
+
+  if (from->histogram) {
+    if (!entry->histogram) {
+      if (!(entry->histogram = calloc(SK_HISTOGRAM_BUCKETS(precision), sizeof(uint32_t)))) {
+        return false;
+      }
+    }
+
+    for (b = 0; b < SK_HISTOGRAM_BUCKETS(precision); ++b) {
+      entry->histogram[b] += from->histogram[b];
+    }
+  }
+
+  if (from->rollups) {
+    if (!entry->rollups) {
+      if (!(entry->rollups = malloc(sizeof(sk_endpoints_t)))) {
+        return false;
+      }
+
+      sk_endpoints_init(entry->rollups, SK_ROLLUP_SUB_BITS);
+    }
+
+    return endpoints_merge(entry->rollups, from->rollups, true);
+  }
+
+  return true;
+}
+
+static bool endpoints_merge(sk_endpoints_t* dst, sk_endpoints_t* src, bool rollups) {
+  long i, j;
+  const char* category;
+  const char* title;
+  size_t category_len, title_len;
+  sk_endpoint_t* from;
+
+  for (i = 0; i < src->len; ++i) {
+    from = &src->entries[i];
+
+    if (rollups) {
+      j = sk_endpoints_lookup(dst, from->name, from->len, dst->len < SK_ROLLUPS_MAX);
+
+      /* Past the limit, new titles go under their category alone */
+      if (j == SK_ENDPOINTS_MISSING) {
+        sk_rollup_key(from, &category, &category_len, &title, &title_len);
+        j = sk_endpoints_lookup(dst, from->name, category_len + 1, true);
+      }
+    }
+    else {
+      j = sk_endpoints_lookup(dst, from->name, from->len, true);
+    }
+
+    if (j < 0 || !endpoint_merge(&dst->entries[j], from, dst->precision)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool sk_endpoints_merge(sk_endpoints_t* dst, sk_endpoints_t* src) {
+  return endpoints_merge(dst, src, false);
+}
+
+/**
+ * class Skylight::EndpointCounter
+ */
+
+static VALUE rb_cEndpointCounter;
+
+static void endpoint_counter_free(sk_endpoints_t* endpoints) {
+  sk_endpoints_destroy(endpoints);
+  free(endpoints);
+}
+
+sk_endpoints_t* sk_endpoints_get(VALUE counter) {
+  sk_endpoints_t* endpoints;
+
+  if (!rb_obj_is_kind_of(counter, rb_cEndpointCounter)) {
+    rb_raise(rb_eArgError, "expected a Skylight::EndpointCounter but was %s", rb_obj_classname(counter));
+  }
+
+  Data_Get_Struct(counter, sk_endpoints_t, endpoints);
+
+  return endpoints;
+}
+
+static VALUE endpoint_counter_new(VALUE klass) {
+  sk_endpoints_t* endpoints = malloc(sizeof(sk_endpoints_t));
+
+  if (!endpoints) {
+    rb_memerror();
+  }
+
+  sk_endpoints_init(endpoints, SK_HISTOGRAM_SUB_BITS);
+
+  return Data_Wrap_Struct(rb_cEndpointCounter, NULL, endpoint_counter_free, endpoints);
+}
+
+/*
+ * Counts a serialized Trace against its endpoint, records the duration of
+ * its root span and rolls up all of its spans. Returns false if the trace
+ * has no endpoint name.
+ */
+static VALUE endpoint_counter_push(VALUE self, VALUE protobuf) {
+  int res;
+  sk_endpoints_t* endpoints = sk_endpoints_get(self);
+
+  CHECK_TYPE(protobuf, T_STRING);
+
+  if ((res = sk_endpoints_push(endpoints, RSTRING_PTR(protobuf), RSTRING_LEN(protobuf))) < 0) {
+    rb_memerror();
+  }
+
+  return res ? Qtrue : Qfalse;
+}
+
+static VALUE endpoint_counter_count(VALUE self, VALUE name) {
+  long i;
+  sk_endpoints_t* endpoints = sk_endpoints_get(self);
+
+  CHECK_TYPE(name, T_STRING);
+
+  if ((i = sk_endpoints_lookup(endpoints, RSTRING_PTR(name), RSTRING_LEN(name), false)) < 0) {
+    return INT2FIX(0);
+  }
+
+  return ULL2NUM(endpoints->entries[i].count);
+}
+
+/*
+ * Returns the histogram of the named endpoint as a Hash of the smallest
+ * duration of each non-empty bucket to its count
+ */
+static VALUE endpoint_counter_histogram(VALUE self, VALUE name) {
+  long i, b;
+  sk_endpoint_t* endpoint;
+  sk_endpoints_t* endpoints = sk_endpoints_get(self);
+  VALUE ret = rb_hash_new();
+
+  CHECK_TYPE(name, T_STRING);
+
+  if ((i = sk_endpoints_lookup(endpoints, RSTRING_PTR(name), RSTRING_LEN(name), false)) < 0) {
+    return ret;
+  }
+
+  endpoint = &endpoints->entries[i];
+
+  if (endpoint->histogram) {
+    for (b = 0; b < SK_HISTOGRAM_BUCKETS(endpoints->precision); ++b) {
+      if (endpoint->histogram[b]) {
+        rb_hash_aset(ret, ULL2NUM(histogram_bucket_min(b, endpoints->precision)), UINT2NUM(endpoint->histogram[b]));
+      }
+    }
+  }
+
+  return ret;
+}
+
+/*
+ * Returns the span rollups of the named endpoint as a Hash of
+ * [category, title] to [count, total, max]. The title is nil for spans
+ * without one, or for those past SK_ROLLUPS_MAX titles.
+ */
+static VALUE endpoint_counter_rollups(VALUE self, VALUE name) {
+  long i;
+  const char* category;
+  const char* title;
+  size_t category_len, title_len;
+  sk_endpoint_t* rollup;
+  sk_endpoints_t* rollups;
+  sk_endpoints_t* endpoints = sk_endpoints_get(self);
+  VALUE key, ret = rb_hash_new();
+
+  CHECK_TYPE(name, T_STRING);
+
+  if ((i = sk_endpoints_lookup(endpoints, RSTRING_PTR(name), RSTRING_LEN(name), false)) < 0) {
+    return ret;
+  }
+
+  if (!(rollups = endpoints->entries[i].rollups)) {
+    return ret;
+  }
+
+  for (i = 0; i < rollups->len; ++i) {
+    rollup = &rollups->entries[i];
+    sk_rollup_key(rollup, &category, &category_len, &title, &title_len);
+
+    key = rb_ary_new3(2, rb_enc_str_new(category, category_len, rb_utf8_encoding()),
+      title_len ? rb_enc_str_new(title, title_len, rb_utf8_encoding()) : Qnil);
+    rb_hash_aset(ret, key, rb_ary_new3(3, ULL2NUM(rollup->count), ULL2NUM(rollup->total), ULL2NUM(rollup->max)));
+  }
+
+  return ret;
+}
+
+static VALUE endpoint_counter_length(VALUE self) {
+  return LONG2NUM(sk_endpoints_get(self)->len);
+}
+
+static VALUE endpoint_counter_counts(VALUE self) {
+  long i;
+  VALUE name;
+  VALUE ret = rb_hash_new();
+  sk_endpoints_t* endpoints = sk_endpoints_get(self);
+
+  for (i = 0; i < endpoints->len; ++i) {
+    name = rb_str_new(endpoints->entries[i].name, endpoints->entries[i].len);
+    rb_enc_associate(name, rb_utf8_encoding());
+    rb_hash_aset(ret, name, ULL2NUM(endpoints->entries[i].count));
+  }
+
+  return ret;
+}
+
+void Init_skylight_endpoints(void) {
+  rb_cEndpointCounter = rb_define_class_under(rb_mSkylight, "EndpointCounter", rb_cObject);
+  rb_define_singleton_method(rb_cEndpointCounter, "native_new", endpoint_counter_new, 0);
+  rb_define_method(rb_cEndpointCounter, "native_push", endpoint_counter_push, 1);
+  rb_define_method(rb_cEndpointCounter, "native_count", endpoint_counter_count, 1);
+  rb_define_method(rb_cEndpointCounter, "native_histogram", endpoint_counter_histogram, 1);
+  rb_define_method(rb_cEndpointCounter, "native_rollups", endpoint_counter_rollups, 1);
+  rb_define_method(rb_cEndpointCounter, "native_length", endpoint_counter_length, 0);
+  rb_define_method(rb_cEndpointCounter, "native_counts", endpoint_counter_counts, 0);
+}
@@ -0,0 +1,173 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <skylight_native.h>
+
+/**
+ * Frame reader
+ *
+ * Decodes the `[id, len].pack("LL") + payload` frames written to the agent's
+ * unix socket. Bytes are received straight into a buffer owned by the
+ * reader, headers are parsed in place and every complete frame is handed
+ * out as its id and a frozen copy of its payload. Only the tail of an
+ * incomplete frame is ever moved, to the front of the buffer.
+ */
+
+#define FRAME_HDR_LEN    8
+#define FRAME_READ_MIN   (16 * 1024)
+#define FRAME_INIT_CAPA  (64 * 1024)
+#define FRAME_MAX_LEN    (128 * 1024 * 1024)
+
+typedef struct {
+  char* buf;
+  size_t start;
+  size_t end;
+  size_t capa;
+} frame_reader_t;
+
+static VALUE rb_cFrameReader;
+
+static void frame_reader_free(frame_reader_t* reader) {
+  free(reader->buf);
+  free(reader);
+}
+
+static VALUE frame_reader_new(VALUE klass) {
+  frame_reader_t* reader;
+
+  if (!(reader = malloc(sizeof(frame_reader_t)))) {
+    rb_memerror();
+  }
+
+  if (!(reader->buf = malloc(FRAME_INIT_CAPA))) {
+    free(reader);
+    rb_memerror();
+  }
+
+  reader->start = 0;
+  reader->end = 0;
+  reader->capa = FRAME_INIT_CAPA;
+
+  return Data_Wrap_Struct(rb_cFrameReader, NULL, frame_reader_free, reader);
+}
+
+/*
+ * Makes room for at least FRAME_READ_MIN more bytes, or for the rest of the
+ * frame at the front of the buffer if that is larger.
+ */
+static void frame_reader_reserve(frame_reader_t* reader) {
+  uint32_t len;
+  size_t need, capa;
+  char* buf;
+
+  if (reader->start > 0) {
+    memmove(reader->buf, reader->buf + reader->start, reader->end - reader->start);
+    reader->end -= reader->start;
+    reader->start = 0;
+  }
+
+  need = reader->end + FRAME_READ_MIN;
+
+  if (reader->end >= FRAME_HDR_LEN) {
+    memcpy(&len, reader->buf + 4, 4);
+
+    if (FRAME_HDR_LEN + (size_t) len > need) {
+      need = FRAME_HDR_LEN + (size_t) len;
+    }
+  }
+
+  if (need <= reader->capa) {
+    return;
+  }
+
+  for (capa = reader->capa; capa < need; capa *= 2);
+
+  if (!(buf = realloc(reader->buf, capa))) {
+    rb_memerror();
+  }
+
+  reader->buf = buf;
+  reader->capa = capa;
+}
+
+/*
+ * Receives whatever is available on the socket without blocking and
+ * appends the id and payload of every complete frame to `frames`. Returns
+ * the number of bytes received; raises EOFError once the peer has closed
+ * the socket.
+ */
+static VALUE frame_reader_read(VALUE self, VALUE rb_fd, VALUE frames) {
+  int fd;
+  ssize_t n;
+  uint32_t id, len;
+  VALUE payload;
+  frame_reader_t* reader;
+
+  Data_Get_Struct(self, frame_reader_t, reader);
+
+  CHECK_TYPE(rb_fd, T_FIXNUM);
+  CHECK_TYPE(frames, T_ARRAY);
+
+  fd = FIX2INT(rb_fd);
+
+  frame_reader_reserve(reader);
+
+  n = recv(fd, reader->buf + reader->end, reader->capa - reader->end, MSG_DONTWAIT);
+
+  if (n == 0) {
+    rb_raise(rb_eEOFError, "end of file reached");
+  }
+
+  if (n < 0) {
+    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+      rb_sys_fail("recv");
+    }
+
+    n = 0;
+  }
+
+  reader->end += n;
+
+  while (reader->end - reader->start >= FRAME_HDR_LEN) {
+    memcpy(&id, reader->buf + reader->start, 4);
+    memcpy(&len, reader->buf + reader->start + 4, 4);
+
+    if (len > FRAME_MAX_LEN) {
+      rb_raise(rb_const_get(rb_mSkylight, rb_intern("IpcProtoError")), "frame too large; len=%u", len);
+    }
+
+    if (reader->end - reader->start < FRAME_HDR_LEN + (size_t) len) {
+      break;
+    }
+
+    payload = rb_str_new(reader->buf + reader->start + FRAME_HDR_LEN, len);
+    rb_obj_freeze(payload);
+
+    rb_ary_push(frames, UINT2NUM(id));
+    rb_ary_push(frames, payload);
+
+    reader->start += FRAME_HDR_LEN + len;
+  }
+
+  if (reader->start == reader->end) {
+    reader->start = reader->end = 0;
+  }
+
+  return LONG2NUM(n);
+}
+
+/* Bytes received but not yet handed out as part of a frame */
+static VALUE frame_reader_pending(VALUE self) {
+  frame_reader_t* reader;
+  Data_Get_Struct(self, frame_reader_t, reader);
+  return SIZET2NUM(reader->end - reader->start);
+}
+
+void Init_skylight_frame_reader(void) {
+  rb_cFrameReader = rb_define_class_under(rb_mSkylight, "FrameReader", rb_cObject);
+  rb_define_singleton_method(rb_cFrameReader, "native_new", frame_reader_new, 0);
+  rb_define_method(rb_cFrameReader, "native_read", frame_reader_read, 2);
+  rb_define_method(rb_cFrameReader, "native_pending", frame_reader_pending, 0);
+}
@@ -0,0 +1,237 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <skylight_native.h>
+
+/**
+ * Frame writer
+ *
+ * Coalesces the `[id, len].pack("LL") + payload` frames sent to the agent
+ * into one contiguous buffer, so that a whole batch of messages goes out in
+ * a single send(). Traces are serialized straight into the buffer.
+ */
+
+#define FRAME_HDR_LEN   8
+#define FRAME_INIT_CAPA (64 * 1024)
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+typedef struct {
+  char* buf;
+  size_t len;
+  size_t sent;
+  size_t capa;
+} frame_writer_t;
+
+static VALUE rb_cFrameWriter;
+
+static void frame_writer_free(frame_writer_t* writer) {
+  free(writer->buf);
+  free(writer);
+}
+
+static frame_writer_t* frame_writer_get(VALUE self) {
+  frame_writer_t* writer;
+  Data_Get_Struct(self, frame_writer_t, writer);
+  return writer;
+}
+
+static VALUE frame_writer_new(VALUE klass) {
+  frame_writer_t* writer;
+
+  if (!(writer = malloc(sizeof(frame_writer_t)))) {
+    rb_memerror();
+  }
+
+  memset(writer, 0, sizeof(frame_writer_t));
+
+  return Data_Wrap_Struct(rb_cFrameWriter, NULL, frame_writer_free, writer);
+}
+
+/* Appends a frame header and returns where its payload of len bytes goes */
+static char* frame_writer_append(frame_writer_t* writer, uint32_t id, size_t len) {
+  uint32_t hdr[2];
+  size_t need, capa;
+  char* buf;
+  char* frame;
+
+  if (len > UINT32_MAX) {
+    rb_raise(rb_eArgError, "message too large; len=%lu", (unsigned long) len);
+  }
+
+  need = writer->len + FRAME_HDR_LEN + len;
+
+  if (need > writer->capa) {
+    for (capa = writer->capa ? writer->capa : FRAME_INIT_CAPA; capa < need; capa *= 2);
+
+    if (!(buf = realloc(writer->buf, capa))) {
+      rb_memerror();
+    }
+
+    writer->buf = buf;
+    writer->capa = capa;
+  }
+
+  hdr[0] = id;
+  hdr[1] = (uint32_t) len;
+
+  frame = writer->buf + writer->len;
+  memcpy(frame, hdr, FRAME_HDR_LEN);
+
+  return frame + FRAME_HDR_LEN;
+}
+
+static VALUE frame_writer_push(VALUE self, VALUE rb_id, VALUE payload) {
+  char* dst;
+  frame_writer_t* writer = frame_writer_get(self);
+
+  CHECK_NUMERIC(rb_id);
+  CHECK_TYPE(payload, T_STRING);
+
+  dst = frame_writer_append(writer, NUM2UINT(rb_id), RSTRING_LEN(payload));
+  memcpy(dst, RSTRING_PTR(payload), RSTRING_LEN(payload));
+  writer->len += FRAME_HDR_LEN + RSTRING_LEN(payload);
+
+  return self;
+}
+
+/*
+ * Serializes a Skylight::Trace, as message id 0, straight into the buffer.
+ * The trace is consumed as if it had been serialized.
+ */
+static VALUE frame_writer_push_trace(VALUE self, VALUE rb_trace) {
+  size_t size;
+  char* dst;
+  RustSlice slice;
+  RustSerializer serializer;
+  frame_writer_t* writer = frame_writer_get(self);
+
+  if (!rb_obj_is_kind_of(rb_trace, rb_cTrace)) {
+    rb_raise(rb_eArgError, "expected a Skylight::Trace but was %s", rb_obj_classname(rb_trace));
+  }
+
+  Transfer_Struct(trace, rb_trace, RustTrace, "You can't do anything with a Trace once it's been serialized");
+
+  if (!skylight_trace_get_serializer(trace, &serializer)) {
+    skylight_trace_free(trace);
+    rb_raise(rb_eRuntimeError, "could not get serializer for trace");
+  }
+
+  if (!skylight_serializer_get_serialized_size(serializer, &size)) {
+    skylight_serializer_free(serializer);
+    skylight_trace_free(trace);
+    rb_raise(rb_eRuntimeError, "could not get serialized size for trace");
+  }
+
+  dst = frame_writer_append(writer, 0, size);
+
+  slice.data = dst;
+  slice.len = size;
+
+  if (!skylight_trace_serialize(trace, serializer, slice)) {
+    skylight_serializer_free(serializer);
+    skylight_trace_free(trace);
+    rb_raise(rb_eRuntimeError, "could not serialize trace");
+  }
+
+  skylight_serializer_free(serializer);
+  skylight_trace_free(trace);
+
+  writer->len += FRAME_HDR_LEN + size;
+
+  return self;
+}
+
+/*
+ * Sends as much of the buffer as the socket takes without blocking.
+ * Returns the number of bytes still waiting to be sent.
+ */
+static VALUE frame_writer_write(VALUE self, VALUE rb_fd) {
+  int fd;
+  ssize_t n;
+  frame_writer_t* writer = frame_writer_get(self);
+
+  CHECK_TYPE(rb_fd, T_FIXNUM);
+
+  fd = FIX2INT(rb_fd);
+
+  while (writer->sent < writer->len) {
+    n = send(fd, writer->buf + writer->sent, writer->len - writer->sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        break;
+      }
+
+      rb_sys_fail("send");
+    }
+
+    writer->sent += n;
+  }
+
+  if (writer->sent == writer->len) {
+    writer->sent = writer->len = 0;
+  }
+
+  return SIZET2NUM(writer->len - writer->sent);
+}
+
+/*
+ * Prepares the buffer to be sent again, over a new connection. A frame that
+ * was partially sent can't be completed on another socket, so it is
+ * dropped; every frame after it is kept. Returns the number of frames
+ * dropped.
+ */
+static VALUE frame_writer_restart(VALUE self) {
+  uint32_t len;
+  size_t pos = 0, next;
+  long dropped = 0;
+  frame_writer_t* writer = frame_writer_get(self);
+
+  while (pos < writer->sent) {
+    memcpy(&len, writer->buf + pos + 4, 4);
+    next = pos + FRAME_HDR_LEN + len;
+
+    if (next > writer->sent) {
+      dropped = 1;
+    }
+
+    pos = next;
+  }
+
+  memmove(writer->buf, writer->buf + pos, writer->len - pos);
+  writer->len -= pos;
+  writer->sent = 0;
+
+  return LONG2NUM(dropped);
+}
+
+static VALUE frame_writer_length(VALUE self) {
+  frame_writer_t* writer = frame_writer_get(self);
+  return SIZET2NUM(writer->len - writer->sent);
+}
+
+static VALUE frame_writer_clear(VALUE self) {
+  frame_writer_t* writer = frame_writer_get(self);
+  writer->len = writer->sent = 0;
+  return self;
+}
+
+void Init_skylight_frame_writer(void) {
+  rb_cFrameWriter = rb_define_class_under(rb_mSkylight, "FrameWriter", rb_cObject);
+  rb_define_singleton_method(rb_cFrameWriter, "native_new", frame_writer_new, 0);
+  rb_define_method(rb_cFrameWriter, "native_push", frame_writer_push, 2);
+  rb_define_method(rb_cFrameWriter, "native_push_trace", frame_writer_push_trace, 1);
+  rb_define_method(rb_cFrameWriter, "native_write", frame_writer_write, 1);
+  rb_define_method(rb_cFrameWriter, "native_restart", frame_writer_restart, 0);
+  rb_define_method(rb_cFrameWriter, "native_length", frame_writer_length, 0);
+  rb_define_method(rb_cFrameWriter, "native_clear", frame_writer_clear, 0);
+}
@@ -0,0 +1,121 @@
+#include <time.h>
+#include <skylight_native.h>
+
+#ifdef HAVE_RUBY_DEBUG_H
+#include <ruby/debug.h>
+#endif
+
+/**
+ * GC tracker
+ *
+ * Keeps a process wide count of the nanoseconds spent in GC, from
+ * tracepoints on the VM's internal GC events. The count only ever grows, so
+ * a trace snapshots it when it starts and subtracts, with no lock and no
+ * per trace bookkeeping.
+ *
+ * Where the VM reports entering and leaving GC, every step of incremental
+ * marking and lazy sweeping is counted. Older VMs only report when marking
+ * starts and ends, so sweeping is left out there.
+ *
+ * GC events fire with the GVL held and the counters are read with it held,
+ * so no further synchronization is needed.
+ */
+
+#if defined(HAVE_RB_TRACEPOINT_NEW) && defined(RUBY_INTERNAL_EVENT_GC_START)
+#define GC_TRACKER_SUPPORTED 1
+
+#ifdef RUBY_INTERNAL_EVENT_GC_ENTER
+#define GC_TRACKER_ENTER RUBY_INTERNAL_EVENT_GC_ENTER
+#define GC_TRACKER_EXIT  RUBY_INTERNAL_EVENT_GC_EXIT
+#else
+#define GC_TRACKER_ENTER RUBY_INTERNAL_EVENT_GC_START
+#define GC_TRACKER_EXIT  RUBY_INTERNAL_EVENT_GC_END_MARK
+#endif
+
+static VALUE gc_tracepoint = Qnil;
+static uint64_t gc_entered_at;
+static uint64_t gc_total;
+static uint64_t gc_count;
+
+static uint64_t gc_nanos(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t) now.tv_sec * 1000000000ULL + (uint64_t) now.tv_nsec;
+}
+
+/* Runs inside GC, so it must not allocate or raise */
+static void gc_event(VALUE tpval, void* data) {
+  rb_event_flag_t event = rb_tracearg_event_flag(rb_tracearg_from_tracepoint(tpval));
+
+  if (event == GC_TRACKER_ENTER) {
+    gc_entered_at = gc_nanos();
+  }
+  else if (gc_entered_at) {
+    gc_total += gc_nanos() - gc_entered_at;
+    gc_entered_at = 0;
+    gc_count++;
+  }
+}
+#endif
+
+/* Whether GC time can be tracked natively on this VM */
+static VALUE gc_supported(VALUE klass) {
+#ifdef GC_TRACKER_SUPPORTED
+  return Qtrue;
+#else
+  return Qfalse;
+#endif
+}
+
+/* Starts tracking GC time, if it isn't already. Returns whether it is. */
+static VALUE gc_enable(VALUE klass) {
+#ifdef GC_TRACKER_SUPPORTED
+  if (NIL_P(gc_tracepoint)) {
+    gc_tracepoint = rb_tracepoint_new(0, GC_TRACKER_ENTER | GC_TRACKER_EXIT, gc_event, NULL);
+    rb_gc_register_address(&gc_tracepoint);
+  }
+
+  rb_tracepoint_enable(gc_tracepoint);
+
+  return Qtrue;
+#else
+  return Qfalse;
+#endif
+}
+
+static VALUE gc_disable(VALUE klass) {
+#ifdef GC_TRACKER_SUPPORTED
+  if (!NIL_P(gc_tracepoint)) {
+    rb_tracepoint_disable(gc_tracepoint);
+  }
+#endif
+
+  return Qnil;
+}
+
+/* Nanoseconds spent in GC while tracking was enabled */
+static VALUE gc_total_time(VALUE klass) {
+#ifdef GC_TRACKER_SUPPORTED
+  return ULL2NUM(gc_total);
+#else
+  return INT2FIX(0);
+#endif
+}
+
+/* Number of GC runs, or steps of them, counted */
+static VALUE gc_runs(VALUE klass) {
+#ifdef GC_TRACKER_SUPPORTED
+  return ULL2NUM(gc_count);
+#else
+  return INT2FIX(0);
+#endif
+}
+
+void Init_skylight_gc(void) {
+  VALUE rb_cGcTracker = rb_define_class_under(rb_mSkylight, "GcTracker", rb_cObject);
+  rb_define_singleton_method(rb_cGcTracker, "native_supported?", gc_supported, 0);
+  rb_define_singleton_method(rb_cGcTracker, "native_enable", gc_enable, 0);
+  rb_define_singleton_method(rb_cGcTracker, "native_disable", gc_disable, 0);
+  rb_define_singleton_method(rb_cGcTracker, "native_total_time", gc_total_time, 0);
+  rb_define_singleton_method(rb_cGcTracker, "native_runs", gc_runs, 0);
+}
@@ -0,0 +1,411 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <skylight_native.h>
+
+/**
+ * Ingest shards
+ *
+ * Spreads the collector's per trace work, counting, rolling up spans and
+ * sampling, over native threads that never take the GVL. Every trace is
+ * routed by the hash of its endpoint name, so each endpoint is counted on
+ * a single shard, and each shard has an endpoint table and reservoir of
+ * its own.
+ *
+ * Pushing copies the trace bytes onto its shard's bounded queue; when the
+ * queue is full the pushing thread waits for room without the GVL rather
+ * than lose the trace. Draining waits for every shard to go idle, then
+ * merges their tables and samples into an EndpointCounter and a Reservoir
+ * and starts the shards over. Traces a shard could not take in for lack of
+ * memory are counted rather than raised, so the rest of the interval is
+ * still reported.
+ *
+ * Only one Ruby thread, the collector's, is expected to push and drain.
+ */
+
+#define INGEST_QUEUE_CAPA 1024
+#define INGEST_MAX_SHARDS 256
+
+typedef struct {
+  char* data;
+  size_t len;
+} ingest_item_t;
+
+typedef struct {
+  pthread_t thread;
+  pthread_mutex_t lock;
+
+  /* Signaled when an item is queued or the shard is stopping */
+  pthread_cond_t ready;
+
+  /* Signaled when an item is taken off a full queue */
+  pthread_cond_t space;
+
+  /* Signaled when the queue runs empty */
+  pthread_cond_t idle;
+
+  ingest_item_t items[INGEST_QUEUE_CAPA];
+  long head;
+  long len;
+  bool busy;
+  bool stop;
+
+  /* Traces queued, and those that ran out of memory, since the last drain */
+  uint64_t pushed;
+  uint64_t failures;
+
+  sk_endpoints_t endpoints;
+  sk_reservoir_t reservoir;
+} ingest_shard_t;
+
+typedef struct {
+  ingest_shard_t* shards;
+  long nshards;
+  long started;
+
+  /* Traces pushed since the last drain */
+  uint64_t count;
+
+  /* Traces lost by the last drain */
+  uint64_t failures;
+} ingest_t;
+
+static VALUE rb_cIngestShards;
+
+static void* ingest_work(void* ptr) {
+  ingest_shard_t* shard = (ingest_shard_t*) ptr;
+  ingest_item_t item;
+  bool ok;
+
+  pthread_mutex_lock(&shard->lock);
+
+  while (true) {
+    while (!shard->len && !shard->stop) {
+      pthread_cond_wait(&shard->ready, &shard->lock);
+    }
+
+    if (shard->stop) {
+      break;
+    }
+
+    item = shard->items[shard->head];
+    shard->head = (shard->head + 1) % INGEST_QUEUE_CAPA;
+
+    if (shard->len-- == INGEST_QUEUE_CAPA) {
+      pthread_cond_signal(&shard->space);
+    }
+
+    shard->busy = true;
+    pthread_mutex_unlock(&shard->lock);
+
+    /* Traces without a name were never queued */
+    ok = sk_endpoints_push(&shard->endpoints, item.data, item.len) >= 0 &&
+      sk_reservoir_push(&shard->reservoir, item.data, item.len) >= 0;
+
+    free(item.data);
+
+    pthread_mutex_lock(&shard->lock);
+    shard->busy = false;
+
+    if (!ok) {
+      shard->failures++;
+    }
+
+    if (!shard->len) {
+      pthread_cond_broadcast(&shard->idle);
+    }
+  }
+
+  pthread_mutex_unlock(&shard->lock);
+
+  return NULL;
+}
+
+static void ingest_free(ingest_t* ingest) {
+  long i;
+  ingest_shard_t* shard;
+
+  for (i = 0; i < ingest->started; ++i) {
+    shard = &ingest->shards[i];
+
+    pthread_mutex_lock(&shard->lock);
+    shard->stop = true;
+    pthread_cond_signal(&shard->ready);
+    pthread_mutex_unlock(&shard->lock);
+
+    pthread_join(shard->thread, NULL);
+  }
+
+  for (i = 0; i < ingest->nshards; ++i) {
+    shard = &ingest->shards[i];
+
+    for (; shard->len > 0; --shard->len) {
+      free(shard->items[shard->head].data);
+      shard->head = (shard->head + 1) % INGEST_QUEUE_CAPA;
+    }
+
+    sk_endpoints_destroy(&shard->endpoints);
+    sk_reservoir_destroy(&shard->reservoir);
+
+    pthread_cond_destroy(&shard->idle);
+    pthread_cond_destroy(&shard->space);
+    pthread_cond_destroy(&shard->ready);
+    pthread_mutex_destroy(&shard->lock);
+  }
+
+  free(ingest->shards);
+  free(ingest);
+}
+
+static ingest_t* ingest_get(VALUE self) {
+  ingest_t* ingest;
+  Data_Get_Struct(self, ingest_t, ingest);
+  return ingest;
+}
+
+static uint64_t ingest_seed(void) {
+  return ((uint64_t) rb_genrand_int32() << 32) | rb_genrand_int32() | 1;
+}
+
+/*
+ * Starts nshards threads, each sampling up to size traces, weighted by
+ * duration when weighted is true
+ */
+static VALUE ingest_new(VALUE klass, VALUE rb_nshards, VALUE rb_size, VALUE weighted) {
+  long i, nshards, size;
+  int err = 0;
+  sigset_t all, prev;
+  ingest_t* ingest;
+  ingest_shard_t* shard;
+
+  CHECK_NUMERIC(rb_nshards);
+  CHECK_NUMERIC(rb_size);
+
+  nshards = NUM2LONG(rb_nshards);
+  size = NUM2LONG(rb_size);
+
+  if (nshards <= 0 || nshards > INGEST_MAX_SHARDS) {
+    rb_raise(rb_eArgError, "shards must be between 1 and %d; shards=%ld", INGEST_MAX_SHARDS, nshards);
+  }
+
+  if (size < 0) {
+    rb_raise(rb_eArgError, "reservoir size must not be negative");
+  }
+
+  if (!(ingest = malloc(sizeof(ingest_t)))) {
+    rb_memerror();
+  }
+
+  memset(ingest, 0, sizeof(ingest_t));
+
+  if (!(ingest->shards = calloc(nshards, sizeof(ingest_shard_t)))) {
+    free(ingest);
+    rb_memerror();
+  }
+
+  ingest->nshards = nshards;
+
+  for (i = 0; i < nshards; ++i) {
+    shard = &ingest->shards[i];
+
+    pthread_mutex_init(&shard->lock, NULL);
+    pthread_cond_init(&shard->ready, NULL);
+    pthread_cond_init(&shard->space, NULL);
+    pthread_cond_init(&shard->idle, NULL);
+
+    sk_endpoints_init(&shard->endpoints, SK_HISTOGRAM_SUB_BITS);
+    sk_reservoir_init(&shard->reservoir, size, RTEST(weighted));
+    sk_reservoir_seed(&shard->reservoir, ingest_seed());
+  }
+
+  /* Signals are for Ruby's threads to handle */
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &prev);
+
+  for (i = 0; i < nshards && !err; ++i) {
+    if (!(err = pthread_create(&ingest->shards[i].thread, NULL, ingest_work, &ingest->shards[i]))) {
+      ingest->started++;
+    }
+  }
+
+  pthread_sigmask(SIG_SETMASK, &prev, NULL);
+
+  if (err) {
+    ingest_free(ingest);
+    errno = err;
+    rb_sys_fail("pthread_create");
+  }
+
+  return Data_Wrap_Struct(rb_cIngestShards, NULL, ingest_free, ingest);
+}
+
+static void* ingest_wait_space(void* ptr) {
+  ingest_shard_t* shard = (ingest_shard_t*) ptr;
+
+  pthread_mutex_lock(&shard->lock);
+
+  while (shard->len == INGEST_QUEUE_CAPA) {
+    pthread_cond_wait(&shard->space, &shard->lock);
+  }
+
+  pthread_mutex_unlock(&shard->lock);
+
+  return NULL;
+}
+
+/*
+ * Queues a serialized Trace on the shard of its endpoint. Returns false if
+ * the trace has no endpoint name, in which case it is neither counted nor
+ * sampled.
+ */
+static VALUE ingest_push(VALUE self, VALUE protobuf) {
+  const char* name;
+  size_t len;
+  ingest_item_t item;
+  ingest_shard_t* shard;
+  ingest_t* ingest = ingest_get(self);
+
+  CHECK_TYPE(protobuf, T_STRING);
+
+  if (!sk_trace_endpoint_name(RSTRING_PTR(protobuf), RSTRING_LEN(protobuf), &name, &len)) {
+    return Qfalse;
+  }
+
+  shard = &ingest->shards[sk_hash(name, len) % ingest->nshards];
+
+  item.len = RSTRING_LEN(protobuf);
+
+  if (!(item.data = malloc(item.len ? item.len : 1))) {
+    rb_memerror();
+  }
+
+  memcpy(item.data, RSTRING_PTR(protobuf), item.len);
+
+  pthread_mutex_lock(&shard->lock);
+
+  while (shard->len == INGEST_QUEUE_CAPA) {
+    pthread_mutex_unlock(&shard->lock);
+    sk_without_gvl(ingest_wait_space, shard, NULL, NULL);
+    pthread_mutex_lock(&shard->lock);
+  }
+
+  shard->items[(shard->head + shard->len) % INGEST_QUEUE_CAPA] = item;
+  shard->pushed++;
+
+  if (shard->len++ == 0) {
+    pthread_cond_signal(&shard->ready);
+  }
+
+  pthread_mutex_unlock(&shard->lock);
+
+  ingest->count++;
+
+  return Qtrue;
+}
+
+/* Returns with every shard idle and locked */
+static void* ingest_lock_idle(void* ptr) {
+  long i;
+  ingest_t* ingest = (ingest_t*) ptr;
+  ingest_shard_t* shard;
+
+  for (i = 0; i < ingest->nshards; ++i) {
+    shard = &ingest->shards[i];
+
+    pthread_mutex_lock(&shard->lock);
+
+    while (shard->len || shard->busy) {
+      pthread_cond_wait(&shard->idle, &shard->lock);
+    }
+  }
+
+  return NULL;
+}
+
+/*
+ * Waits for the shards to work through their queues, then adds their
+ * counts to counter, merges their samples into sample and starts them
+ * over. Returns the number of traces drained.
+ *
+ * Whatever the shards took in is merged even if some traces could not be;
+ * those, and the traces of a shard whose table could not be merged, are
+ * counted in native_failures. When the samples could not be merged, sample
+ * is left as it was.
+ */
+static VALUE ingest_drain(VALUE self, VALUE counter, VALUE sample) {
+  long i;
+  uint64_t count;
+  ingest_shard_t* shard;
+  sk_reservoir_t** reservoirs;
+  ingest_t* ingest = ingest_get(self);
+  sk_endpoints_t* endpoints = sk_endpoints_get(counter);
+  sk_reservoir_t* reservoir = sk_reservoir_get(sample);
+
+  /* Before touching the shards, which keep their traces if this fails */
+  if (!(reservoirs = malloc(ingest->nshards * sizeof(sk_reservoir_t*)))) {
+    rb_memerror();
+  }
+
+  sk_without_gvl(ingest_lock_idle, ingest, NULL, NULL);
+
+  ingest->failures = 0;
+
+  for (i = 0; i < ingest->nshards; ++i) {
+    shard = &ingest->shards[i];
+
+    if (sk_endpoints_merge(endpoints, &shard->endpoints)) {
+      ingest->failures += shard->failures;
+    }
+    else {
+      ingest->failures += shard->pushed;
+    }
+
+    reservoirs[i] = &shard->reservoir;
+  }
+
+  sk_reservoir_merge(reservoir, reservoirs, ingest->nshards);
+
+  for (i = 0; i < ingest->nshards; ++i) {
+    shard = &ingest->shards[i];
+
+    sk_endpoints_destroy(&shard->endpoints);
+    sk_reservoir_clear(&shard->reservoir);
+    shard->pushed = 0;
+    shard->failures = 0;
+
+    pthread_mutex_unlock(&shard->lock);
+  }
+
+  free(reservoirs);
+
+  count = ingest->count;
+  ingest->count = 0;
+
+  return ULL2NUM(count);
+}
+
+/* Traces that could not be counted or sampled, as of the last drain */
+static VALUE ingest_failures(VALUE self) {
+  return ULL2NUM(ingest_get(self)->failures);
+}
+
+/* Traces pushed since the last drain */
+static VALUE ingest_count(VALUE self) {
+  return ULL2NUM(ingest_get(self)->count);
+}
+
+static VALUE ingest_length(VALUE self) {
+  return LONG2NUM(ingest_get(self)->nshards);
+}
+
+void Init_skylight_ingest(void) {
+  rb_cIngestShards = rb_define_class_under(rb_mSkylight, "IngestShards", rb_cObject);
+  rb_define_singleton_method(rb_cIngestShards, "native_new", ingest_new, 3);
+  rb_define_method(rb_cIngestShards, "native_push", ingest_push, 1);
+  rb_define_method(rb_cIngestShards, "native_drain", ingest_drain, 2);
+  rb_define_method(rb_cIngestShards, "native_count", ingest_count, 0);
+  rb_define_method(rb_cIngestShards, "native_failures", ingest_failures, 0);
+  rb_define_method(rb_cIngestShards, "native_length", ingest_length, 0);
+}
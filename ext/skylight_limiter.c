@@ -0,0 +1,289 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <skylight_native.h>
+
+/**
+ * Description limiter
+ *
+ * Tracks the distinct span descriptions seen per endpoint, so that an
+ * endpoint can't produce more than a fixed number of them. Descriptions
+ * are stored as 64 bit fingerprints in a fixed size, open-addressed set per
+ * endpoint, and endpoints in a table sized when the limiter is created, so
+ * memory stays bounded however many endpoints and descriptions come
+ * through. Endpoints past the table's capacity share its last slot, and so
+ * share a single budget of descriptions.
+ *
+ * Slots are claimed with compare and swap and never freed while the
+ * limiter is alive, so no lock is taken, whichever thread is asking and
+ * whether or not it holds the GVL.
+ *
+ * When a window is given, every endpoint's set starts over once that many
+ * seconds have passed since it was last cleared.
+ */
+
+typedef struct {
+  volatile uint64_t key;
+  volatile uint32_t count;
+  volatile uint64_t window;
+  uint64_t* volatile set;
+} limiter_endpoint_t;
+
+typedef struct {
+  limiter_endpoint_t* endpoints;
+  long nendpoints;
+  uint32_t max;
+  long nslots;
+  long window;
+} limiter_t;
+
+static VALUE rb_cDescriptionLimiter;
+
+/* FNV-1a, 64 bit. Zero marks an empty slot, so it is never returned. */
+static uint64_t limiter_fingerprint(VALUE str) {
+  const uint8_t* bytes;
+  uint64_t hash = 14695981039346656037ULL;
+  long i, len;
+
+  if (NIL_P(str)) {
+    return 1;
+  }
+
+  bytes = (const uint8_t*) RSTRING_PTR(str);
+  len = RSTRING_LEN(str);
+
+  for (i = 0; i < len; ++i) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ULL;
+  }
+
+  return hash > 1 ? hash : hash + 2;
+}
+
+static void limiter_free(limiter_t* limiter) {
+  long i;
+
+  if (limiter->endpoints) {
+    for (i = 0; i < limiter->nendpoints; ++i) {
+      free(limiter->endpoints[i].set);
+    }
+  }
+
+  free(limiter->endpoints);
+  free(limiter);
+}
+
+static limiter_t* limiter_get(VALUE self) {
+  limiter_t* limiter;
+  Data_Get_Struct(self, limiter_t, limiter);
+  return limiter;
+}
+
+/*
+ * max is the number of distinct descriptions allowed per endpoint, window
+ * the number of seconds after which they are forgotten, or 0 to never
+ * forget them, and endpoints the number of endpoints that get a budget of
+ * their own
+ */
+static VALUE limiter_new(VALUE klass, VALUE rb_max, VALUE rb_window, VALUE rb_endpoints) {
+  long max, window, endpoints, nslots, nendpoints;
+  limiter_t* limiter;
+
+  CHECK_NUMERIC(rb_max);
+  CHECK_NUMERIC(rb_window);
+  CHECK_NUMERIC(rb_endpoints);
+
+  max = NUM2LONG(rb_max);
+  window = NUM2LONG(rb_window);
+  endpoints = NUM2LONG(rb_endpoints);
+
+  if (max <= 0 || max > 1024 * 1024) {
+    rb_raise(rb_eArgError, "max must be between 1 and 1048576; max=%ld", max);
+  }
+
+  if (window < 0) {
+    rb_raise(rb_eArgError, "window must be >= 0; window=%ld", window);
+  }
+
+  if (endpoints <= 0 || endpoints > 64 * 1024) {
+    rb_raise(rb_eArgError, "endpoints must be between 1 and 65536; endpoints=%ld", endpoints);
+  }
+
+  /* Keep the sets at most half full */
+  for (nslots = 16; nslots < max * 2; nslots *= 2);
+
+  /* One more than asked for, for the overflow slot */
+  for (nendpoints = 2; nendpoints < endpoints + 1; nendpoints *= 2);
+
+  if (!(limiter = malloc(sizeof(limiter_t)))) {
+    rb_memerror();
+  }
+
+  memset(limiter, 0, sizeof(limiter_t));
+
+  if (!(limiter->endpoints = calloc(nendpoints, sizeof(limiter_endpoint_t)))) {
+    free(limiter);
+    rb_memerror();
+  }
+
+  limiter->nendpoints = nendpoints;
+  limiter->max = (uint32_t) max;
+  limiter->nslots = nslots;
+  limiter->window = window;
+
+  return Data_Wrap_Struct(rb_cDescriptionLimiter, NULL, limiter_free, limiter);
+}
+
+static uint64_t limiter_window(limiter_t* limiter) {
+  struct timespec now;
+
+  if (!limiter->window) {
+    return 0;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (uint64_t) now.tv_sec / limiter->window;
+}
+
+/*
+ * Returns the endpoint's slot, claiming one if it has none yet and create
+ * is set. Returns NULL if it has none and create is not set, unless the
+ * table is full, in which case the endpoint is in the overflow slot.
+ */
+static limiter_endpoint_t* limiter_endpoint(limiter_t* limiter, uint64_t key, bool create) {
+  long i, mask = limiter->nendpoints - 1, slot = (long) (key & mask);
+  uint64_t curr;
+  limiter_endpoint_t* endpoint;
+  limiter_endpoint_t* overflow = &limiter->endpoints[mask];
+
+  for (i = 0; i < limiter->nendpoints; ++i) {
+    endpoint = &limiter->endpoints[(slot + i) & mask];
+
+    /* The last slot is the overflow */
+    if (endpoint == overflow) {
+      continue;
+    }
+
+    if ((curr = endpoint->key) == key) {
+      return endpoint;
+    }
+
+    if (curr == 0) {
+      if (!create) {
+        return NULL;
+      }
+
+      if (__sync_bool_compare_and_swap(&endpoint->key, 0, key) || endpoint->key == key) {
+        return endpoint;
+      }
+    }
+  }
+
+  return overflow;
+}
+
+static uint64_t* limiter_set(limiter_t* limiter, limiter_endpoint_t* endpoint) {
+  uint64_t* set;
+
+  if ((set = endpoint->set)) {
+    return set;
+  }
+
+  if (!(set = calloc(limiter->nslots, sizeof(uint64_t)))) {
+    return NULL;
+  }
+
+  if (!__sync_bool_compare_and_swap(&endpoint->set, NULL, set)) {
+    free(set);
+    set = endpoint->set;
+  }
+
+  return set;
+}
+
+/*
+ * Records the description against the endpoint. Returns true if it was
+ * seen before or there was room for it, false if the endpoint already has
+ * as many distinct descriptions as allowed.
+ */
+static VALUE limiter_add(VALUE self, VALUE rb_endpoint, VALUE description) {
+  long i, slot;
+  uint64_t fingerprint, curr, window;
+  uint64_t* set;
+  limiter_endpoint_t* endpoint;
+  limiter_t* limiter = limiter_get(self);
+
+  if (!NIL_P(rb_endpoint)) {
+    CHECK_TYPE(rb_endpoint, T_STRING);
+  }
+
+  if (!NIL_P(description)) {
+    CHECK_TYPE(description, T_STRING);
+  }
+
+  endpoint = limiter_endpoint(limiter, limiter_fingerprint(rb_endpoint), true);
+
+  if (!(set = limiter_set(limiter, endpoint))) {
+    rb_memerror();
+  }
+
+  window = limiter_window(limiter);
+
+  if ((curr = endpoint->window) != window && __sync_bool_compare_and_swap(&endpoint->window, curr, window)) {
+    memset(set, 0, limiter->nslots * sizeof(uint64_t));
+    endpoint->count = 0;
+    __sync_synchronize();
+  }
+
+  fingerprint = limiter_fingerprint(description);
+  slot = (long) (fingerprint & (limiter->nslots - 1));
+
+  for (i = 0; i < limiter->nslots; ++i, slot = (slot + 1) & (limiter->nslots - 1)) {
+    if ((curr = set[slot]) == fingerprint) {
+      return Qtrue;
+    }
+
+    if (curr != 0) {
+      continue;
+    }
+
+    if (endpoint->count >= limiter->max) {
+      return Qfalse;
+    }
+
+    if (__sync_bool_compare_and_swap(&set[slot], 0, fingerprint)) {
+      __sync_fetch_and_add(&endpoint->count, 1);
+      return Qtrue;
+    }
+
+    if (set[slot] == fingerprint) {
+      return Qtrue;
+    }
+  }
+
+  return Qfalse;
+}
+
+/* Number of distinct descriptions recorded against the endpoint */
+static VALUE limiter_count(VALUE self, VALUE rb_endpoint) {
+  limiter_endpoint_t* endpoint;
+  limiter_t* limiter = limiter_get(self);
+
+  if (!NIL_P(rb_endpoint)) {
+    CHECK_TYPE(rb_endpoint, T_STRING);
+  }
+
+  if (!(endpoint = limiter_endpoint(limiter, limiter_fingerprint(rb_endpoint), false))) {
+    return INT2FIX(0);
+  }
+
+  return UINT2NUM(endpoint->count);
+}
+
+void Init_skylight_limiter(void) {
+  rb_cDescriptionLimiter = rb_define_class_under(rb_mSkylight, "DescriptionLimiter", rb_cObject);
+  rb_define_singleton_method(rb_cDescriptionLimiter, "native_new", limiter_new, 3);
+  rb_define_method(rb_cDescriptionLimiter, "native_add", limiter_add, 2);
+  rb_define_method(rb_cDescriptionLimiter, "native_count", limiter_count, 1);
+}
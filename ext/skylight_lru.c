@@ -0,0 +1,278 @@
+#include <stdlib.h>
+#include <string.h>
+#include <skylight_native.h>
+
+/**
+ * LRU cache
+ *
+ * Maps Strings to arbitrary Ruby objects, holding at most a fixed number
+ * of entries and evicting the least recently used one to make room. Keys
+ * are compared by their bytes.
+ *
+ * Entries live in a single array allocated up front. They are chained off
+ * a hashed index and threaded on a doubly linked list from most to least
+ * recently used, all by array index, so lookups and evictions never
+ * allocate. Every call runs with the GVL held, which is all the locking
+ * the cache needs.
+ */
+
+typedef struct {
+  VALUE key;
+  VALUE value;
+  uint32_t hash;
+
+  /* Neighbours in recency order */
+  long prev;
+  long next;
+
+  /* Next entry in the same index bucket */
+  long chain;
+} lru_entry_t;
+
+typedef struct {
+  lru_entry_t* entries;
+  long size;
+  long len;
+
+  /* Most and least recently used entries */
+  long head;
+  long tail;
+
+  /* Heads of the bucket chains, -1 when empty */
+  long* buckets;
+  long nbuckets;
+
+  uint64_t hits;
+  uint64_t misses;
+} lru_t;
+
+static VALUE rb_cLruCache;
+
+static void lru_mark(lru_t* lru) {
+  long i;
+
+  for (i = 0; i < lru->len; ++i) {
+    rb_gc_mark(lru->entries[i].key);
+    rb_gc_mark(lru->entries[i].value);
+  }
+}
+
+static void lru_free(lru_t* lru) {
+  free(lru->entries);
+  free(lru->buckets);
+  free(lru);
+}
+
+static lru_t* lru_get(VALUE self) {
+  lru_t* lru;
+  Data_Get_Struct(self, lru_t, lru);
+  return lru;
+}
+
+static void lru_reset(lru_t* lru) {
+  long i;
+
+  lru->len = 0;
+  lru->head = -1;
+  lru->tail = -1;
+
+  for (i = 0; i < lru->nbuckets; ++i) {
+    lru->buckets[i] = -1;
+  }
+}
+
+static VALUE lru_new(VALUE klass, VALUE rb_size) {
+  long size, nbuckets;
+  lru_t* lru;
+
+  CHECK_NUMERIC(rb_size);
+
+  if ((size = NUM2LONG(rb_size)) <= 0) {
+    rb_raise(rb_eArgError, "cache size must be positive");
+  }
+
+  /* Keep the index at most half full */
+  for (nbuckets = 16; nbuckets < size * 2; nbuckets *= 2);
+
+  if (!(lru = malloc(sizeof(lru_t)))) {
+    rb_memerror();
+  }
+
+  memset(lru, 0, sizeof(lru_t));
+
+  lru->entries = malloc(size * sizeof(lru_entry_t));
+  lru->buckets = malloc(nbuckets * sizeof(long));
+
+  if (!lru->entries || !lru->buckets) {
+    lru_free(lru);
+    rb_memerror();
+  }
+
+  lru->size = size;
+  lru->nbuckets = nbuckets;
+
+  lru_reset(lru);
+
+  return Data_Wrap_Struct(rb_cLruCache, lru_mark, lru_free, lru);
+}
+
+static void lru_unlink(lru_t* lru, long i) {
+  lru_entry_t* entry = &lru->entries[i];
+
+  if (entry->prev >= 0) {
+    lru->entries[entry->prev].next = entry->next;
+  }
+  else {
+    lru->head = entry->next;
+  }
+
+  if (entry->next >= 0) {
+    lru->entries[entry->next].prev = entry->prev;
+  }
+  else {
+    lru->tail = entry->prev;
+  }
+}
+
+static void lru_link_head(lru_t* lru, long i) {
+  lru_entry_t* entry = &lru->entries[i];
+
+  entry->prev = -1;
+  entry->next = lru->head;
+
+  if (lru->head >= 0) {
+    lru->entries[lru->head].prev = i;
+  }
+  else {
+    lru->tail = i;
+  }
+
+  lru->head = i;
+}
+
+static long lru_find(lru_t* lru, const char* key, long len, uint32_t hash) {
+  long i;
+  lru_entry_t* entry;
+
+  for (i = lru->buckets[hash & (lru->nbuckets - 1)]; i >= 0; i = entry->chain) {
+    entry = &lru->entries[i];
+
+    if (entry->hash == hash && RSTRING_LEN(entry->key) == len && memcmp(RSTRING_PTR(entry->key), key, len) == 0) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+/* Takes an entry out of its bucket's chain */
+static void lru_unindex(lru_t* lru, long i) {
+  long* link = &lru->buckets[lru->entries[i].hash & (lru->nbuckets - 1)];
+
+  while (*link != i) {
+    link = &lru->entries[*link].chain;
+  }
+
+  *link = lru->entries[i].chain;
+}
+
+/*
+ * Returns the value cached for key, marking it as the most recently used,
+ * or nil if there is none
+ */
+static VALUE lru_lookup(VALUE self, VALUE key) {
+  long i;
+  lru_t* lru = lru_get(self);
+
+  CHECK_TYPE(key, T_STRING);
+
+  i = lru_find(lru, RSTRING_PTR(key), RSTRING_LEN(key), sk_hash(RSTRING_PTR(key), RSTRING_LEN(key)));
+
+  if (i < 0) {
+    lru->misses++;
+    return Qnil;
+  }
+
+  lru->hits++;
+
+  if (lru->head != i) {
+    lru_unlink(lru, i);
+    lru_link_head(lru, i);
+  }
+
+  return lru->entries[i].value;
+}
+
+/*
+ * Caches value under key, evicting the least recently used entry when the
+ * cache is full. The key is frozen, copying it first unless it already is.
+ */
+static VALUE lru_store(VALUE self, VALUE key, VALUE value) {
+  long i, bucket;
+  uint32_t hash;
+  lru_entry_t* entry;
+  lru_t* lru = lru_get(self);
+
+  CHECK_TYPE(key, T_STRING);
+
+  hash = sk_hash(RSTRING_PTR(key), RSTRING_LEN(key));
+
+  if ((i = lru_find(lru, RSTRING_PTR(key), RSTRING_LEN(key), hash)) >= 0) {
+    lru->entries[i].value = value;
+    lru_unlink(lru, i);
+  }
+  else {
+    key = rb_str_new_frozen(key);
+
+    if (lru->len < lru->size) {
+      i = lru->len++;
+    }
+    else {
+      i = lru->tail;
+      lru_unlink(lru, i);
+      lru_unindex(lru, i);
+    }
+
+    bucket = hash & (lru->nbuckets - 1);
+
+    entry = &lru->entries[i];
+    entry->key = key;
+    entry->value = value;
+    entry->hash = hash;
+    entry->chain = lru->buckets[bucket];
+
+    lru->buckets[bucket] = i;
+  }
+
+  lru_link_head(lru, i);
+
+  return value;
+}
+
+static VALUE lru_length(VALUE self) {
+  return LONG2NUM(lru_get(self)->len);
+}
+
+static VALUE lru_clear(VALUE self) {
+  lru_reset(lru_get(self));
+  return self;
+}
+
+static VALUE lru_hits(VALUE self) {
+  return ULL2NUM(lru_get(self)->hits);
+}
+
+static VALUE lru_misses(VALUE self) {
+  return ULL2NUM(lru_get(self)->misses);
+}
+
+void Init_skylight_lru(void) {
+  rb_cLruCache = rb_define_class_under(rb_mSkylight, "LruCache", rb_cObject);
+  rb_define_singleton_method(rb_cLruCache, "native_new", lru_new, 1);
+  rb_define_method(rb_cLruCache, "native_get", lru_lookup, 1);
+  rb_define_method(rb_cLruCache, "native_set", lru_store, 2);
+  rb_define_method(rb_cLruCache, "native_length", lru_length, 0);
+  rb_define_method(rb_cLruCache, "native_clear", lru_clear, 0);
+  rb_define_method(rb_cLruCache, "native_hits", lru_hits, 0);
+  rb_define_method(rb_cLruCache, "native_misses", lru_misses, 0);
+}
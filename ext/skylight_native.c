@@ -1,14 +1,69 @@
-#include <skylight.h>
-#include <ruby.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <skylight_native.h>
+#include <skylight_protobuf.h>
 
 #ifdef HAVE_RUBY_ENCODING_H
 #include <ruby/encoding.h>
 #endif
 
+#ifdef HAVE_ZLIB_H
+#define SK_HAVE_ZLIB 1
+#include <zlib.h>
+#endif
+
 /**
  * Ruby helpers
  */
 
+/*
+ * Messages at least this large are serialized with the GVL released, so
+ * that other threads, like the agent's IPC reader, keep running meanwhile.
+ */
+#define SERIALIZE_NOGVL_MIN (64 * 1024)
+
+typedef bool (*serialize_fn)(void*, RustSerializer, RustSlice);
+
+typedef struct {
+  serialize_fn serialize;
+  void* msg;
+  RustSerializer serializer;
+  RustSlice slice;
+  bool ok;
+} serialize_call_t;
+
+static void* serialize_without_gvl(void* data) {
+  serialize_call_t* call = (serialize_call_t*) data;
+  call->ok = call->serialize(call->msg, call->serializer, call->slice);
+  return NULL;
+}
+
+/*
+ * Serializes msg into str, which is already sized to fit. The message is
+ * owned by the caller and str is referenced from this frame only, so
+ * nothing else can touch either while the GVL is released.
+ */
+static bool serialize_into(serialize_fn serialize, void* msg, RustSerializer serializer, VALUE str) {
+  serialize_call_t call;
+
+  call.serialize = serialize;
+  call.msg = msg;
+  call.serializer = serializer;
+  call.slice = STR2SLICE(str);
+  call.ok = false;
+
+  if (call.slice.len < SERIALIZE_NOGVL_MIN) {
+    return serialize(msg, serializer, call.slice);
+  }
+
+  sk_without_gvl(serialize_without_gvl, &call, NULL, NULL);
+
+  RB_GC_GUARD(str);
+
+  return call.ok;
+}
+
 #define SERIALIZE(MSG)                                                                                                     \
   ({                                                                                                                       \
     VALUE ret;                                                                                                             \
@@ -24,7 +79,7 @@
       CHECK_FFI(skylight_serializer_get_serialized_size(serializer, &size), "could not get serialized size for "#MSG);     \
       ret = rb_str_new(NULL, size);                                                                                        \
                                                                                                                            \
-      CHECK_FFI(skylight_ ## MSG ## _serialize(MSG, serializer, STR2SLICE(ret)), "could not serialize "#MSG);              \
+      CHECK_FFI(serialize_into(skylight_ ## MSG ## _serialize, MSG, serializer, ret), "could not serialize "#MSG);         \
       skylight_serializer_free(serializer);                                                                                \
     }                                                                                                                      \
                                                                                                                            \
@@ -32,6 +87,99 @@
     ret;                                                                                                                   \
   })
 
+/**
+ * Interned strings
+ *
+ * Categories and titles repeat across every span of every trace. Interning
+ * them once per process lets callers pass a small integer instead of a Ruby
+ * String that has to be type checked and sliced on each call. Interned
+ * strings are never freed.
+ */
+
+#define INTERN_MAX 4096
+#define INTERN_BUCKETS 8192
+
+typedef struct {
+  char* data;
+  long len;
+  uint32_t hash;
+} interned_t;
+
+static interned_t interned[INTERN_MAX];
+static int32_t interned_buckets[INTERN_BUCKETS];
+static uint32_t interned_len = 0;
+
+/*
+ * Returns the id of the interned copy of the string, interning it if needed,
+ * or -1 if the table is full.
+ */
+static int32_t intern_str(const char* data, long len) {
+  uint32_t hash = sk_hash(data, len);
+  uint32_t bucket = hash % INTERN_BUCKETS;
+  interned_t* entry;
+  int32_t id;
+
+  /* Buckets hold id + 1 so that a zeroed table is empty */
+  while ((id = interned_buckets[bucket] - 1) >= 0) {
+    entry = &interned[id];
+
+    if (entry->hash == hash && entry->len == len && memcmp(entry->data, data, len) == 0) {
+      return id;
+    }
+
+    bucket = (bucket + 1) % INTERN_BUCKETS;
+  }
+
+  if (interned_len == INTERN_MAX) {
+    return -1;
+  }
+
+  id = interned_len;
+  entry = &interned[id];
+
+  entry->data = malloc(len);
+  if (len && !entry->data) {
+    return -1;
+  }
+
+  memcpy(entry->data, data, len);
+  entry->len = len;
+  entry->hash = hash;
+
+  interned_buckets[bucket] = id + 1;
+  interned_len++;
+
+  return id;
+}
+
+/*
+ * Converts a String or an interned String id into a slice
+ */
+static RustSlice str_or_interned(VALUE val) {
+  RustSlice slice;
+  long id;
+
+  if (FIXNUM_P(val)) {
+    id = FIX2LONG(val);
+
+    if (id < 0 || id >= (long) interned_len) {
+      rb_raise(rb_eArgError, "unknown interned string id %ld", id);
+    }
+
+    slice.data = interned[id].data;
+    slice.len = interned[id].len;
+
+    return slice;
+  }
+
+  if (TYPE(val) != T_STRING) {
+    rb_raise(rb_eArgError, "expected a String or an interned String id but was '%s' (%s [%i])",
+             TO_S(val), rb_obj_classname(val), TYPE(val));
+  }
+
+  return STR2SLICE(val);
+}
+
 /**
  * Ruby types defined here
  */
@@ -54,6 +202,69 @@ static VALUE clock_high_res_time(VALUE self) {
   return ULL2NUM(time);
 }
 
+/*
+ * Traces are timed in ticks of 100 microseconds. Reading the clock and
+ * scaling it here, rather than handing nanoseconds to Ruby, keeps every
+ * value a Fixnum.
+ *
+ * Where CLOCK_MONOTONIC is available it is read directly, which on Linux
+ * is served from the vDSO without a system call. It is shifted by its
+ * offset from skylight_high_res_time, measured once at load, so ticks
+ * read here line up with timestamps taken through Clock#native_hrtime.
+ */
+
+#define CLOCK_TICK_NANOS 100000
+
+#ifdef CLOCK_MONOTONIC
+static int64_t clock_offset;
+
+static uint64_t clock_monotonic_nanos(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t) now.tv_sec * 1000000000ULL + (uint64_t) now.tv_nsec;
+}
+
+static void clock_calibrate(void) {
+  uint64_t hrtime;
+
+  if (skylight_high_res_time(&hrtime)) {
+    clock_offset = (int64_t) (hrtime - clock_monotonic_nanos());
+  }
+}
+
+static uint64_t clock_nanos(void) {
+  return clock_monotonic_nanos() + clock_offset;
+}
+#else
+static void clock_calibrate(void) {
+}
+
+static uint64_t clock_nanos(void) {
+  uint64_t time;
+  CHECK_FFI(skylight_high_res_time(&time), "Could not get high-res time");
+  return time;
+}
+#endif
+
+/*
+ * Current time in ticks, less gc nanoseconds of GC time that the trace
+ * should not be charged for
+ */
+static uint64_t clock_ticks(VALUE gc) {
+  uint64_t now = clock_nanos();
+  uint64_t skip;
+
+  CHECK_NUMERIC(gc);
+
+  skip = NUM2ULL(gc);
+
+  return (skip < now ? now - skip : 0) / CLOCK_TICK_NANOS;
+}
+
+static VALUE clock_native_ticks(VALUE self) {
+  return ULL2NUM(clock_nanos() / CLOCK_TICK_NANOS);
+}
+
 /**
  * class Skylight::Hello
  */
@@ -218,6 +429,28 @@ static VALUE trace_new(VALUE self, VALUE started_at, VALUE uuid) {
   return Data_Wrap_Struct(rb_cTrace, NULL, skylight_trace_free, trace);
 }
 
+/*
+ * Points a Trace at a new native trace, so that the Ruby object of one
+ * that was serialized can be reused for another request. A trace that was
+ * never serialized is freed first.
+ */
+static VALUE trace_reset(VALUE self, VALUE started_at, VALUE uuid) {
+  RustTrace trace;
+
+  CHECK_NUMERIC(started_at);
+  CHECK_TYPE(uuid, T_STRING);
+
+  CHECK_FFI(skylight_trace_new(NUM2ULL(started_at), STR2SLICE(uuid), &trace), "Could not created Trace");
+
+  if (DATA_PTR(self)) {
+    skylight_trace_free(DATA_PTR(self));
+  }
+
+  DATA_PTR(self) = trace;
+
+  return self;
+}
+
 static VALUE trace_name_from_serialized(VALUE self, VALUE protobuf) {
   CHECK_TYPE(protobuf, T_STRING);
 
@@ -279,6 +512,32 @@ static VALUE trace_start_span(VALUE self, VALUE time, VALUE category) {
   return UINT2NUM(span);
 }
 
+static VALUE trace_intern(VALUE klass, VALUE str) {
+  int32_t id;
+
+  CHECK_TYPE(str, T_STRING);
+
+  id = intern_str(RSTRING_PTR(str), RSTRING_LEN(str));
+
+  if (id < 0) {
+    return Qnil;
+  }
+
+  return INT2FIX(id);
+}
+
+static VALUE trace_start_span_interned(VALUE self, VALUE time, VALUE category_id) {
+  uint32_t span;
+  My_Struct(trace, RustTrace, freedTrace);
+
+  CHECK_NUMERIC(time);
+  CHECK_TYPE(category_id, T_FIXNUM);
+
+  CHECK_FFI(skylight_trace_start_span(trace, NUM2ULL(time), str_or_interned(category_id), &span), "Could not start Span");
+
+  return UINT2NUM(span);
+}
+
 static VALUE trace_stop_span(VALUE self, VALUE span_index, VALUE time) {
   My_Struct(trace, RustTrace, freedTrace);
 
@@ -290,6 +549,44 @@ static VALUE trace_stop_span(VALUE self, VALUE span_index, VALUE time) {
   return Qnil;
 }
 
+/*
+ * Like native_start_span, with the start time read off the clock. gc is
+ * the GC time to discount, in nanoseconds. Title and description may be
+ * nil and the category and title interned ids.
+ */
+static VALUE trace_start_span_now(VALUE self, VALUE gc, VALUE category, VALUE title, VALUE description) {
+  uint32_t span;
+  My_Struct(trace, RustTrace, freedTrace);
+
+  CHECK_FFI(skylight_trace_start_span(trace, clock_ticks(gc), str_or_interned(category), &span), "Could not start Span");
+
+  if (title != Qnil) {
+    CHECK_FFI(skylight_trace_span_set_title(trace, span, str_or_interned(title)), "Could not set Span title");
+  }
+
+  if (description != Qnil) {
+    CHECK_TYPE(description, T_STRING);
+    CHECK_FFI(skylight_trace_span_set_description(trace, span, STR2SLICE(description)), "Could not set Span description");
+  }
+
+  return UINT2NUM(span);
+}
+
+static VALUE trace_stop_span_now(VALUE self, VALUE span_index, VALUE gc) {
+  My_Struct(trace, RustTrace, freedTrace);
+
+  CHECK_TYPE(span_index, T_FIXNUM);
+
+  CHECK_FFI(skylight_trace_stop_span(trace, FIX2UINT(span_index), clock_ticks(gc)), "Could not stop Span");
+
+  return Qnil;
+}
+
+/* Current time in ticks, for spans buffered through native_record_spans */
+static VALUE trace_now(VALUE self, VALUE gc) {
+  return ULL2NUM(clock_ticks(gc));
+}
+
 static VALUE trace_span_set_title(VALUE self, VALUE index, VALUE title) {
   My_Struct(trace, RustTrace, freedTrace);
 
@@ -301,6 +598,17 @@ static VALUE trace_span_set_title(VALUE self, VALUE index, VALUE title) {
   return Qnil;
 }
 
+static VALUE trace_span_set_title_interned(VALUE self, VALUE index, VALUE title_id) {
+  My_Struct(trace, RustTrace, freedTrace);
+
+  CHECK_TYPE(index, T_FIXNUM);
+  CHECK_TYPE(title_id, T_FIXNUM);
+
+  CHECK_FFI(skylight_trace_span_set_title(trace, NUM2LL(index), str_or_interned(title_id)), "Could not set Span title");
+
+  return Qnil;
+}
+
 static VALUE trace_span_set_description(VALUE self, VALUE index, VALUE description) {
   My_Struct(trace, RustTrace, freedTrace);
 
@@ -311,6 +619,61 @@ static VALUE trace_span_set_description(VALUE self, VALUE index, VALUE descripti
   return Qnil;
 }
 
+/*
+ * Records many spans in a single call. `records` is a flat Array of
+ * [started_at, stopped_at, category, title, description] groups. A nil
+ * stopped_at leaves the span open; title and description may be nil.
+ * Categories and titles may be given as interned String ids.
+ *
+ * Returns the index of the last span started, or nil if there were none.
+ */
+static VALUE trace_record_spans(VALUE self, VALUE records) {
+  long i, len;
+  uint32_t span;
+  VALUE started_at, stopped_at, category, title, description;
+  VALUE ret = Qnil;
+
+  My_Struct(trace, RustTrace, freedTrace);
+
+  CHECK_TYPE(records, T_ARRAY);
+
+  len = RARRAY_LEN(records);
+
+  if (len % 5 != 0) {
+    rb_raise(rb_eArgError, "expected span records in groups of 5 but got %ld values", len);
+  }
+
+  for (i = 0; i < len; i += 5) {
+    started_at  = rb_ary_entry(records, i);
+    stopped_at  = rb_ary_entry(records, i + 1);
+    category    = rb_ary_entry(records, i + 2);
+    title       = rb_ary_entry(records, i + 3);
+    description = rb_ary_entry(records, i + 4);
+
+    CHECK_NUMERIC(started_at);
+
+    CHECK_FFI(skylight_trace_start_span(trace, NUM2ULL(started_at), str_or_interned(category), &span), "Could not start Span");
+
+    if (title != Qnil) {
+      CHECK_FFI(skylight_trace_span_set_title(trace, span, str_or_interned(title)), "Could not set Span title");
+    }
+
+    if (description != Qnil) {
+      CHECK_TYPE(description, T_STRING);
+      CHECK_FFI(skylight_trace_span_set_description(trace, span, STR2SLICE(description)), "Could not set Span description");
+    }
+
+    if (stopped_at != Qnil) {
+      CHECK_NUMERIC(stopped_at);
+      CHECK_FFI(skylight_trace_stop_span(trace, span, NUM2ULL(stopped_at)), "Could not stop Span");
+    }
+
+    ret = UINT2NUM(span);
+  }
+
+  return ret;
+}
+
 static VALUE trace_serialize(VALUE self) {
   Transfer_My_Struct(trace, RustTrace, freedTrace);
   return SERIALIZE(trace);
@@ -369,12 +732,473 @@ VALUE batch_serialize(VALUE self) {
   return SERIALIZE(batch);
 }
 
+/*
+ * Batch encoding
+ *
+ * Sampled traces arrive already serialized. Rather than moving each one into
+ * a RustBatch (one copy) and serializing that (a second copy), the Batch
+ * message is written directly: every serialized trace is copied exactly once,
+ * into the final output buffer, and is never decoded.
+ */
+
+#define BATCH_TIMESTAMP 1
+#define BATCH_ENDPOINTS 2
+#define BATCH_HOSTNAME  3
+
+#define ENDPOINT_NAME      1
+#define ENDPOINT_COUNT     2
+#define ENDPOINT_TRACES    3
+#define ENDPOINT_HISTOGRAM 4
+#define ENDPOINT_ROLLUPS   5
+
+#define ROLLUP_CATEGORY  1
+#define ROLLUP_TITLE     2
+#define ROLLUP_COUNT     3
+#define ROLLUP_TOTAL     4
+#define ROLLUP_MAX       5
+#define ROLLUP_HISTOGRAM 6
+
+/* Reads trace i out of either an Array of Strings or a Reservoir */
+static void batch_trace_at(VALUE traces, sk_reservoir_t* reservoir, long i, const char** data, size_t* len) {
+  VALUE trace;
+
+  if (reservoir) {
+    *data = reservoir->arena + reservoir->samples[i].offset;
+    *len = reservoir->samples[i].len;
+  }
+  else {
+    trace = rb_ary_entry(traces, i);
+    *data = RSTRING_PTR(trace);
+    *len = RSTRING_LEN(trace);
+  }
+}
+
+/* Everything needed to write the Batch, without touching any Ruby object */
+typedef struct {
+  pb_writer_t w;
+  uint32_t timestamp;
+  const char* hostname;
+  size_t hostname_len;
+  sk_endpoints_t* endpoints;
+  long* heads;
+  long* next;
+  size_t* sizes;
+  const char** traces;
+  size_t* trace_lens;
+
+#ifdef SK_HAVE_ZLIB
+  /* When set, the Batch is streamed through deflate instead */
+  z_stream* z;
+  uint8_t* chunk;
+  size_t chunk_len;
+  uint8_t* out;
+  size_t out_len;
+  size_t out_capa;
+  bool failed;
+#endif
+} batch_writer_t;
+
+#ifdef SK_HAVE_ZLIB
+
+/*
+ * Batches are gzipped in fixed size chunks, so that the uncompressed Batch
+ * never has to exist in memory all at once
+ */
+#define BATCH_CHUNK (64 * 1024)
+
+static void batch_deflate(batch_writer_t* b, const void* data, size_t len, int flush) {
+  int res;
+  size_t capa;
+  uint8_t* out;
+
+  b->z->next_in = (Bytef*) data;
+  b->z->avail_in = (uInt) len;
+
+  while (!b->failed) {
+    if (b->out_capa - b->out_len < BATCH_CHUNK) {
+      capa = b->out_capa * 2;
+
+      if (!(out = realloc(b->out, capa))) {
+        b->failed = true;
+        break;
+      }
+
+      b->out = out;
+      b->out_capa = capa;
+    }
+
+    b->z->next_out = b->out + b->out_len;
+    b->z->avail_out = (uInt) (b->out_capa - b->out_len);
+
+    res = deflate(b->z, flush);
+
+    b->out_len = b->out_capa - b->z->avail_out;
+
+    if (res == Z_STREAM_ERROR) {
+      b->failed = true;
+    }
+    else if (flush == Z_FINISH ? res == Z_STREAM_END : b->z->avail_in == 0 && b->z->avail_out > 0) {
+      break;
+    }
+  }
+}
+
+#endif
+
+static void batch_emit(batch_writer_t* b, const void* data, size_t len) {
+#ifdef SK_HAVE_ZLIB
+  if (b->z) {
+    if (len > BATCH_CHUNK - b->chunk_len) {
+      batch_deflate(b, b->chunk, b->chunk_len, Z_NO_FLUSH);
+      b->chunk_len = 0;
+
+      /* Large traces go to deflate as they are */
+      if (len > BATCH_CHUNK) {
+        batch_deflate(b, data, len, Z_NO_FLUSH);
+        return;
+      }
+    }
+
+    memcpy(b->chunk + b->chunk_len, data, len);
+    b->chunk_len += len;
+
+    return;
+  }
+#endif
+
+  pb_write_raw(&b->w, data, len);
+}
+
+static void batch_emit_header(batch_writer_t* b, int field, size_t len) {
+  uint8_t buf[20];
+  pb_writer_t w = { buf, buf + sizeof(buf) };
+
+  pb_write_header(&w, field, len);
+  batch_emit(b, buf, w.pos - buf);
+}
+
+static void batch_emit_bytes(batch_writer_t* b, int field, const void* data, size_t len) {
+  batch_emit_header(b, field, len);
+  batch_emit(b, data, len);
+}
+
+static void batch_emit_uint(batch_writer_t* b, int field, uint64_t val) {
+  uint8_t buf[20];
+  pb_writer_t w = { buf, buf + sizeof(buf) };
+
+  pb_write_uint(&w, field, val);
+  batch_emit(b, buf, w.pos - buf);
+}
+
+static void batch_emit_histogram(batch_writer_t* b, sk_endpoints_t* table, sk_endpoint_t* entry, int field) {
+  uint8_t buf[SK_HISTOGRAM_MAX_SIZE];
+  pb_writer_t w = { buf, buf + sizeof(buf) };
+
+  sk_histogram_write(table, entry, field, &w);
+  batch_emit(b, buf, w.pos - buf);
+}
+
+static size_t batch_rollup_size(sk_endpoints_t* rollups, sk_endpoint_t* rollup) {
+  const char* category;
+  const char* title;
+  size_t category_len, title_len, size;
+
+  sk_rollup_key(rollup, &category, &category_len, &title, &title_len);
+
+  size = pb_bytes_size(ROLLUP_CATEGORY, category_len) +
+    pb_uint_size(ROLLUP_COUNT, rollup->count) +
+    pb_uint_size(ROLLUP_TOTAL, rollup->total) +
+    pb_uint_size(ROLLUP_MAX, rollup->max) +
+    sk_histogram_size(rollups, rollup, ROLLUP_HISTOGRAM);
+
+  if (title_len) {
+    size += pb_bytes_size(ROLLUP_TITLE, title_len);
+  }
+
+  return size;
+}
+
+/* Size of all of an endpoint's Rollup fields */
+static size_t batch_rollups_size(sk_endpoints_t* rollups) {
+  long i;
+  size_t size = 0;
+
+  for (i = 0; rollups && i < rollups->len; ++i) {
+    size += pb_bytes_size(ENDPOINT_ROLLUPS, batch_rollup_size(rollups, &rollups->entries[i]));
+  }
+
+  return size;
+}
+
+static void batch_emit_rollups(batch_writer_t* b, sk_endpoints_t* rollups) {
+  long i;
+  const char* category;
+  const char* title;
+  size_t category_len, title_len;
+  sk_endpoint_t* rollup;
+
+  for (i = 0; rollups && i < rollups->len; ++i) {
+    rollup = &rollups->entries[i];
+    sk_rollup_key(rollup, &category, &category_len, &title, &title_len);
+
+    batch_emit_header(b, ENDPOINT_ROLLUPS, batch_rollup_size(rollups, rollup));
+    batch_emit_bytes(b, ROLLUP_CATEGORY, category, category_len);
+
+    if (title_len) {
+      batch_emit_bytes(b, ROLLUP_TITLE, title, title_len);
+    }
+
+    batch_emit_uint(b, ROLLUP_COUNT, rollup->count);
+    batch_emit_uint(b, ROLLUP_TOTAL, rollup->total);
+    batch_emit_uint(b, ROLLUP_MAX, rollup->max);
+    batch_emit_histogram(b, rollups, rollup, ROLLUP_HISTOGRAM);
+  }
+}
+
+static void* batch_write(void* data) {
+  long e, i;
+  batch_writer_t* b = (batch_writer_t*) data;
+  sk_endpoints_t* endpoints = b->endpoints;
+
+  batch_emit_uint(b, BATCH_TIMESTAMP, b->timestamp);
+
+  for (e = 0; e < endpoints->len; ++e) {
+    batch_emit_header(b, BATCH_ENDPOINTS, b->sizes[e]);
+    batch_emit_bytes(b, ENDPOINT_NAME, endpoints->entries[e].name, endpoints->entries[e].len);
+    batch_emit_uint(b, ENDPOINT_COUNT, endpoints->entries[e].count);
+
+    for (i = b->heads[e]; i >= 0; i = b->next[i]) {
+      batch_emit_bytes(b, ENDPOINT_TRACES, b->traces[i], b->trace_lens[i]);
+    }
+
+    batch_emit_histogram(b, endpoints, &endpoints->entries[e], ENDPOINT_HISTOGRAM);
+    batch_emit_rollups(b, endpoints->entries[e].rollups);
+  }
+
+  if (b->hostname) {
+    batch_emit_bytes(b, BATCH_HOSTNAME, b->hostname, b->hostname_len);
+  }
+
+#ifdef SK_HAVE_ZLIB
+  if (b->z) {
+    batch_deflate(b, b->chunk, b->chunk_len, Z_FINISH);
+    b->chunk_len = 0;
+  }
+#endif
+
+  return NULL;
+}
+
+#ifdef SK_HAVE_ZLIB
+
+/* Gzips the Batch described by b, which has an uncompressed size of size */
+static VALUE batch_write_gzip(batch_writer_t* b, size_t size, int level) {
+  int res;
+  VALUE ret;
+  z_stream z;
+
+  memset(&z, 0, sizeof(z_stream));
+
+  /* 16 + the default window size selects the gzip format */
+  if ((res = deflateInit2(&z, level, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY)) != Z_OK) {
+    if (res == Z_MEM_ERROR) {
+      rb_memerror();
+    }
+
+    rb_raise(rb_eArgError, "could not initialize deflate; level=%d", level);
+  }
+
+  b->z = &z;
+  b->chunk_len = 0;
+  b->out_len = 0;
+  b->out_capa = size / 4 + BATCH_CHUNK * 2;
+  b->failed = false;
+  b->chunk = malloc(BATCH_CHUNK);
+  b->out = malloc(b->out_capa);
+
+  if (!b->chunk || !b->out) {
+    b->failed = true;
+  }
+  else if (size < SERIALIZE_NOGVL_MIN) {
+    batch_write(b);
+  }
+  else {
+    sk_without_gvl(batch_write, b, NULL, NULL);
+  }
+
+  deflateEnd(&z);
+  free(b->chunk);
+
+  if (b->failed) {
+    free(b->out);
+    rb_memerror();
+  }
+
+  ret = rb_str_new((const char*) b->out, b->out_len);
+  free(b->out);
+
+  return ret;
+}
+
+#endif
+
+/*
+ * Encodes a Batch from the endpoint counts in a Skylight::EndpointCounter
+ * and the sampled, serialized Traces, given either as a Skylight::Reservoir
+ * or an Array. Traces are grouped under their endpoint by reading the name
+ * out of the serialized message.
+ *
+ * When a compression level is given the Batch comes back gzipped; see
+ * Batch::NATIVE_GZIP.
+ *
+ * Copying the traces into a large Batch happens with the GVL released. The
+ * counter, the traces and the output are owned by the calling thread, and
+ * stay referenced from this frame throughout.
+ */
+static VALUE batch_encode(int argc, VALUE* argv, VALUE klass) {
+  long i, e, ntraces;
+  size_t size, len;
+  const char* name;
+  VALUE rb_timestamp, rb_hostname, counter, traces, rb_level;
+  VALUE ret, scratch;
+  batch_writer_t b;
+  sk_reservoir_t* reservoir = NULL;
+  sk_endpoints_t* endpoints;
+#ifdef SK_HAVE_ZLIB
+  int level = 0;
+#endif
+
+  rb_scan_args(argc, argv, "41", &rb_timestamp, &rb_hostname, &counter, &traces, &rb_level);
+
+  endpoints = sk_endpoints_get(counter);
+
+  CHECK_NUMERIC(rb_timestamp);
+
+  if (rb_hostname != Qnil) {
+    CHECK_TYPE(rb_hostname, T_STRING);
+  }
+
+  if (rb_level != Qnil) {
+#ifdef SK_HAVE_ZLIB
+    CHECK_NUMERIC(rb_level);
+
+    level = NUM2INT(rb_level);
+
+    if (level < Z_DEFAULT_COMPRESSION || level > Z_BEST_COMPRESSION) {
+      rb_raise(rb_eArgError, "compression level must be between -1 and 9; level=%d", level);
+    }
+#else
+    rb_raise(rb_eNotImpError, "skylight_native was built without zlib");
+#endif
+  }
+
+  if (TYPE(traces) == T_ARRAY) {
+    ntraces = RARRAY_LEN(traces);
+
+    for (i = 0; i < ntraces; ++i) {
+      CHECK_TYPE(rb_ary_entry(traces, i), T_STRING);
+    }
+  }
+  else {
+    reservoir = sk_reservoir_get(traces);
+    ntraces = reservoir->len;
+  }
+
+  memset(&b, 0, sizeof(batch_writer_t));
+
+  b.endpoints = endpoints;
+  b.timestamp = (uint32_t) NUM2ULONG(rb_timestamp);
+
+  if (rb_hostname != Qnil) {
+    b.hostname = RSTRING_PTR(rb_hostname);
+    b.hostname_len = RSTRING_LEN(rb_hostname);
+  }
+
+  /*
+   * Chain the traces of each endpoint together, keeping their order, and
+   * total up the size of each endpoint's traces.
+   */
+  scratch = rb_str_new(NULL, (endpoints->len + ntraces) * (sizeof(long) + sizeof(size_t)) + ntraces * sizeof(char*));
+  b.heads = (long*) RSTRING_PTR(scratch);
+  b.next = b.heads + endpoints->len;
+  b.sizes = (size_t*) (b.next + ntraces);
+  b.trace_lens = b.sizes + endpoints->len;
+  b.traces = (const char**) (b.trace_lens + ntraces);
+
+  for (e = 0; e < endpoints->len; ++e) {
+    b.heads[e] = -1;
+    b.sizes[e] = 0;
+  }
+
+  for (i = ntraces - 1; i >= 0; --i) {
+    batch_trace_at(traces, reservoir, i, &b.traces[i], &b.trace_lens[i]);
+    b.next[i] = -1;
+
+    if (!sk_trace_endpoint_name(b.traces[i], b.trace_lens[i], &name, &len)) {
+      continue;
+    }
+
+    if ((e = sk_endpoints_lookup(endpoints, name, len, false)) < 0) {
+      continue;
+    }
+
+    b.next[i] = b.heads[e];
+    b.heads[e] = i;
+    b.sizes[e] += pb_bytes_size(ENDPOINT_TRACES, b.trace_lens[i]);
+  }
+
+  size = pb_uint_size(BATCH_TIMESTAMP, b.timestamp);
+
+  for (e = 0; e < endpoints->len; ++e) {
+    b.sizes[e] += pb_bytes_size(ENDPOINT_NAME, endpoints->entries[e].len) +
+      pb_uint_size(ENDPOINT_COUNT, endpoints->entries[e].count) +
+      sk_histogram_size(endpoints, &endpoints->entries[e], ENDPOINT_HISTOGRAM) +
+      batch_rollups_size(endpoints->entries[e].rollups);
+
+    size += pb_bytes_size(BATCH_ENDPOINTS, b.sizes[e]);
+  }
+
+  if (b.hostname) {
+    size += pb_bytes_size(BATCH_HOSTNAME, b.hostname_len);
+  }
+
+#ifdef SK_HAVE_ZLIB
+  if (rb_level != Qnil) {
+    ret = batch_write_gzip(&b, size, level);
+  }
+  else
+#endif
+  {
+    ret = rb_str_new(NULL, size);
+
+    b.w.pos = (uint8_t*) RSTRING_PTR(ret);
+    b.w.end = b.w.pos + size;
+
+    if (size < SERIALIZE_NOGVL_MIN) {
+      batch_write(&b);
+    }
+    else {
+      sk_without_gvl(batch_write, &b, NULL, NULL);
+    }
+  }
+
+  RB_GC_GUARD(scratch);
+  RB_GC_GUARD(traces);
+  RB_GC_GUARD(counter);
+  RB_GC_GUARD(rb_hostname);
+
+  return ret;
+}
+
 void Init_skylight_native() {
   rb_mSkylight = rb_define_module("Skylight");
   rb_mUtil  = rb_define_module_under(rb_mSkylight, "Util");
 
+  clock_calibrate();
+
   rb_cClock = rb_define_class_under(rb_mUtil, "Clock", rb_cObject);
   rb_define_method(rb_cClock, "native_hrtime", clock_high_res_time, 0);
+  rb_define_method(rb_cClock, "native_ticks", clock_native_ticks, 0);
 
   rb_cHello = rb_define_class_under(rb_mSkylight, "Hello", rb_cObject);
   rb_define_singleton_method(rb_cHello, "native_new", hello_new, 2);
@@ -397,6 +1221,8 @@ void Init_skylight_native() {
   rb_cTrace = rb_define_class_under(rb_mSkylight, "Trace", rb_cObject);
   rb_define_singleton_method(rb_cTrace, "native_new", trace_new, 2);
   rb_define_singleton_method(rb_cTrace, "native_name_from_serialized", trace_name_from_serialized, 1);
+  rb_define_singleton_method(rb_cTrace, "native_intern", trace_intern, 1);
+  rb_define_method(rb_cTrace, "native_reset", trace_reset, 2);
   rb_define_method(rb_cTrace, "native_get_started_at", trace_get_started_at, 0);
   rb_define_method(rb_cTrace, "native_get_name", trace_get_name, 0);
   rb_define_method(rb_cTrace, "native_set_name", trace_set_name, 1);
@@ -406,10 +1232,35 @@ void Init_skylight_native() {
   rb_define_method(rb_cTrace, "native_stop_span", trace_stop_span, 2);
   rb_define_method(rb_cTrace, "native_span_set_title", trace_span_set_title, 2);
   rb_define_method(rb_cTrace, "native_span_set_description", trace_span_set_description, 2);
+  rb_define_method(rb_cTrace, "native_start_span_interned", trace_start_span_interned, 2);
+  rb_define_method(rb_cTrace, "native_span_set_title_interned", trace_span_set_title_interned, 2);
+  rb_define_method(rb_cTrace, "native_record_spans", trace_record_spans, 1);
+  rb_define_method(rb_cTrace, "native_start_span_now", trace_start_span_now, 4);
+  rb_define_method(rb_cTrace, "native_stop_span_now", trace_stop_span_now, 2);
+  rb_define_method(rb_cTrace, "native_now", trace_now, 1);
 
   rb_cBatch = rb_define_class_under(rb_mSkylight, "Batch", rb_cObject);
   rb_define_singleton_method(rb_cBatch, "native_new", batch_new, 2);
+  rb_define_singleton_method(rb_cBatch, "native_encode", batch_encode, -1);
+#ifdef SK_HAVE_ZLIB
+  rb_define_const(rb_cBatch, "NATIVE_GZIP", Qtrue);
+#else
+  rb_define_const(rb_cBatch, "NATIVE_GZIP", Qfalse);
+#endif
   rb_define_method(rb_cBatch, "native_move_in", batch_move_in, 1);
   rb_define_method(rb_cBatch, "native_set_endpoint_count", batch_set_endpoint_count, 2);
   rb_define_method(rb_cBatch, "native_serialize", batch_serialize, 0);
+
+  Init_skylight_endpoints();
+  Init_skylight_reservoir();
+  Init_skylight_ring();
+  Init_skylight_frame_reader();
+  Init_skylight_frame_writer();
+  Init_skylight_queue();
+  Init_skylight_lru();
+  Init_skylight_limiter();
+  Init_skylight_gc();
+  Init_skylight_proc();
+  Init_skylight_poller();
+  Init_skylight_ingest();
 }
@@ -0,0 +1,303 @@
+#ifndef __SKYLIGHT_NATIVE_H__
+#define __SKYLIGHT_NATIVE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <ruby.h>
+#include <skylight.h>
+#include <skylight_protobuf.h>
+
+#ifdef HAVE_RUBY_THREAD_H
+#include <ruby/thread.h>
+#endif
+
+/**
+ * Declarations shared between the extension's source files
+ */
+
+extern VALUE rb_mSkylight;
+extern VALUE rb_cTrace;
+
+/*
+ * Runs func without holding the GVL. ubf is called from another thread to
+ * wake func up when the calling thread is interrupted.
+ */
+#ifdef HAVE_RB_THREAD_CALL_WITHOUT_GVL
+static inline void* sk_without_gvl(void* (*func)(void*), void* data, rb_unblock_function_t* ubf, void* ubf_data) {
+  return rb_thread_call_without_gvl(func, data, ubf, ubf_data);
+}
+#else
+typedef struct {
+  void* (*func)(void*);
+  void* data;
+  void* ret;
+} sk_gvl_call_t;
+
+static inline VALUE sk_gvl_call(void* ptr) {
+  sk_gvl_call_t* call = (sk_gvl_call_t*) ptr;
+  call->ret = call->func(call->data);
+  return Qnil;
+}
+
+static inline void* sk_without_gvl(void* (*func)(void*), void* data, rb_unblock_function_t* ubf, void* ubf_data) {
+  sk_gvl_call_t call;
+
+  call.func = func;
+  call.data = data;
+  call.ret = NULL;
+
+  rb_thread_blocking_region(sk_gvl_call, &call, ubf, ubf_data);
+
+  return call.ret;
+}
+#endif
+
+/* FNV-1a */
+static inline uint32_t sk_hash(const void* data, size_t len) {
+  const uint8_t* bytes = (const uint8_t*) data;
+  uint32_t hash = 2166136261u;
+  size_t i;
+
+  for (i = 0; i < len; ++i) {
+    hash ^= bytes[i];
+    hash *= 16777619u;
+  }
+
+  return hash;
+}
+
+/**
+ * Endpoint table
+ *
+ * Counts traces per endpoint name, along with a histogram of their
+ * durations. Entries are kept in insertion order and are looked up by name
+ * through an open-addressed index.
+ *
+ * Every endpoint also rolls up the spans of all of its traces, sampled or
+ * not, in a table of its own keyed by "category\0title". Rollups keep a
+ * count, total and max duration and a coarser histogram.
+ */
+
+/*
+ * Log-linear histogram buckets: every power of two is split into
+ * 2^precision linear buckets, covering all 32 bit durations with at most
+ * 2^-precision relative error
+ */
+#define SK_HISTOGRAM_BUCKETS(precision) ((32 - (precision) + 1) << (precision))
+
+/* Endpoint histograms are within 1/16, rollups within a power of two */
+#define SK_HISTOGRAM_SUB_BITS 4
+#define SK_ROLLUP_SUB_BITS    0
+
+/* Upper bound on the encoded size of a histogram field */
+#define SK_HISTOGRAM_MAX_SIZE (32 + SK_HISTOGRAM_BUCKETS(SK_HISTOGRAM_SUB_BITS) * 7)
+
+/*
+ * Distinct titles rolled up per endpoint. Spans with new titles past that
+ * are rolled up under their category alone.
+ */
+#define SK_ROLLUPS_MAX 256
+
+struct sk_endpoints_s;
+
+typedef struct {
+  char* name;
+  size_t len;
+  uint32_t hash;
+  uint64_t count;
+  uint64_t total;
+  uint64_t max;
+
+  /* Allocated with the first duration recorded */
+  uint32_t* histogram;
+
+  /* Span rollups of an endpoint, allocated with the first span */
+  struct sk_endpoints_s* rollups;
+} sk_endpoint_t;
+
+typedef struct sk_endpoints_s {
+  sk_endpoint_t* entries;
+  long len;
+  long capa;
+  long* buckets;
+  long nbuckets;
+  int precision;
+
+  /* Scratch space for building rollup keys */
+  char* key;
+  size_t key_capa;
+} sk_endpoints_t;
+
+/* precision is the number of sub bucket bits of the entries' histograms */
+void sk_endpoints_init(sk_endpoints_t* endpoints, int precision);
+void sk_endpoints_destroy(sk_endpoints_t* endpoints);
+
+/*
+ * Returns the index of the named endpoint, adding it when `create` is set.
+ * Returns SK_ENDPOINTS_MISSING if the endpoint is missing and `create` is
+ * not set, or SK_ENDPOINTS_NOMEM if it could not be added.
+ */
+#define SK_ENDPOINTS_MISSING -1
+#define SK_ENDPOINTS_NOMEM   -2
+
+long sk_endpoints_lookup(sk_endpoints_t* endpoints, const char* name, size_t len, bool create);
+
+/*
+ * Counts a serialized Trace against its endpoint and rolls up its spans.
+ * Returns 1 if it was counted, 0 if it has no endpoint name and -1 if
+ * memory could not be allocated.
+ */
+int sk_endpoints_push(sk_endpoints_t* endpoints, const void* trace, size_t len);
+
+/*
+ * Adds the counts, histograms and rollups of src to dst, which must have
+ * the same precision. Returns false if memory could not be allocated.
+ */
+bool sk_endpoints_merge(sk_endpoints_t* dst, sk_endpoints_t* src);
+
+/* Reads the endpoint name out of a serialized Trace */
+bool sk_trace_endpoint_name(const void* trace, size_t len, const char** name, size_t* name_len);
+
+/* Reads the duration of the root span out of a serialized Trace */
+bool sk_trace_duration(const void* trace, size_t len, uint64_t* duration);
+
+/* Size of an entry's histogram as the given field, or 0 if it has none */
+size_t sk_histogram_size(sk_endpoints_t* endpoints, sk_endpoint_t* entry, int field);
+
+/* Writes an entry's histogram as the given field, if it has one */
+void sk_histogram_write(sk_endpoints_t* endpoints, sk_endpoint_t* entry, int field, pb_writer_t* w);
+
+/* Splits a rollup key; title_len is 0 for spans without a title */
+void sk_rollup_key(sk_endpoint_t* rollup, const char** category, size_t* category_len, const char** title, size_t* title_len);
+
+/* Unwraps a Skylight::EndpointCounter */
+sk_endpoints_t* sk_endpoints_get(VALUE counter);
+
+void Init_skylight_endpoints(void);
+
+/**
+ * Reservoir
+ *
+ * A fixed size sample of serialized traces, stored in a single arena.
+ */
+
+typedef struct {
+  size_t offset;
+  size_t len;
+  double key;
+} sk_sample_t;
+
+typedef struct {
+  sk_sample_t* samples;
+  long size;
+  long len;
+  uint64_t count;
+  bool weighted;
+
+  /* Algorithm L state */
+  double w;
+  uint64_t next;
+
+  /*
+   * xorshift state for reservoirs pushed to without the GVL; 0 draws from
+   * Ruby's generator
+   */
+  uint64_t rng;
+
+  char* arena;
+  size_t arena_len;
+  size_t arena_capa;
+  size_t arena_live;
+} sk_reservoir_t;
+
+void sk_reservoir_init(sk_reservoir_t* reservoir, long size, bool weighted);
+void sk_reservoir_destroy(sk_reservoir_t* reservoir);
+void sk_reservoir_clear(sk_reservoir_t* reservoir);
+
+/*
+ * Offers a trace to the sample. Returns 1 if it was kept, 0 if not and -1
+ * if memory could not be allocated.
+ */
+int sk_reservoir_push(sk_reservoir_t* reservoir, const void* data, size_t len);
+
+/*
+ * Gives the reservoir a random number generator of its own, so that it can
+ * be pushed to from threads not holding the GVL. seed must not be 0.
+ */
+void sk_reservoir_seed(sk_reservoir_t* reservoir, uint64_t seed);
+
+/*
+ * Replaces the sample of dst with one drawn from dst and the n reservoirs
+ * in srcs together, as if all of their traces had been pushed to a single
+ * reservoir of dst's size. The sources are left untouched. Returns false
+ * if memory could not be allocated, leaving dst as it was.
+ *
+ * The merged sample is meant to be encoded or merged again; pushing to it
+ * afterwards skews a uniform sample.
+ */
+bool sk_reservoir_merge(sk_reservoir_t* dst, sk_reservoir_t** srcs, long n);
+
+/* Unwraps a Skylight::Reservoir */
+sk_reservoir_t* sk_reservoir_get(VALUE reservoir);
+
+void Init_skylight_reservoir(void);
+
+/**
+ * Shared memory ring, see skylight_ring.c
+ */
+
+void Init_skylight_ring(void);
+
+/**
+ * Socket frame decoder and encoder, see skylight_frame_reader.c and
+ * skylight_frame_writer.c
+ */
+
+void Init_skylight_frame_reader(void);
+void Init_skylight_frame_writer(void);
+
+/**
+ * Bounded multi producer, single consumer queue, see skylight_queue.c
+ */
+
+void Init_skylight_queue(void);
+
+/**
+ * LRU cache, see skylight_lru.c
+ */
+
+void Init_skylight_lru(void);
+
+/**
+ * Per endpoint description limiter, see skylight_limiter.c
+ */
+
+void Init_skylight_limiter(void);
+
+/**
+ * GC time tracker, see skylight_gc.c
+ */
+
+void Init_skylight_gc(void);
+
+/**
+ * /proc sampler for the worker's metrics, see skylight_proc.c
+ */
+
+void Init_skylight_proc(void);
+
+/**
+ * epoll based poller for the worker's sockets, see skylight_poller.c
+ */
+
+void Init_skylight_poller(void);
+
+/**
+ * Sharded ingest threads for the collector, see skylight_ingest.c
+ */
+
+void Init_skylight_ingest(void);
+
+#endif
@@ -0,0 +1,235 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <skylight_native.h>
+
+/**
+ * Poller
+ *
+ * Waits on the worker's listening socket and client sockets through epoll,
+ * so that a wakeup costs the number of ready sockets rather than the number
+ * of connected processes, and is not bound by FD_SETSIZE. The worker's
+ * periodic checks run off a timerfd registered with the same epoll set.
+ *
+ * Sockets registered as edge triggered must be drained until they would
+ * block. Waiting releases the GVL, so the collector and metrics threads
+ * keep running meanwhile.
+ *
+ * Only defined where epoll and timerfd are available; the worker falls back
+ * to IO.select elsewhere.
+ */
+
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_SYS_TIMERFD_H)
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#define POLLER_MAX_EVENTS 256
+
+typedef struct {
+  int epfd;
+  int timerfd;
+  struct epoll_event events[POLLER_MAX_EVENTS];
+} poller_t;
+
+typedef struct {
+  poller_t* poller;
+  int n;
+  int err;
+} poller_wait_t;
+
+static VALUE rb_cPoller;
+
+static void poller_close_fds(poller_t* poller) {
+  if (poller->timerfd >= 0) {
+    close(poller->timerfd);
+    poller->timerfd = -1;
+  }
+
+  if (poller->epfd >= 0) {
+    close(poller->epfd);
+    poller->epfd = -1;
+  }
+}
+
+static void poller_free(poller_t* poller) {
+  poller_close_fds(poller);
+  free(poller);
+}
+
+static poller_t* poller_get(VALUE self) {
+  poller_t* poller;
+  Data_Get_Struct(self, poller_t, poller);
+
+  if (poller->epfd < 0) {
+    rb_raise(rb_eIOError, "poller is closed");
+  }
+
+  return poller;
+}
+
+static VALUE poller_new(VALUE klass) {
+  poller_t* poller;
+
+  if (!(poller = malloc(sizeof(poller_t)))) {
+    rb_memerror();
+  }
+
+  poller->timerfd = -1;
+
+  if ((poller->epfd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+    free(poller);
+    rb_sys_fail("epoll_create1");
+  }
+
+  return Data_Wrap_Struct(rb_cPoller, NULL, poller_free, poller);
+}
+
+static void poller_ctl(poller_t* poller, int op, int fd, uint32_t events) {
+  struct epoll_event ev;
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events = events;
+  ev.data.fd = fd;
+
+  if (epoll_ctl(poller->epfd, op, fd, &ev) < 0) {
+    rb_sys_fail("epoll_ctl");
+  }
+}
+
+/* Watches fd for reads, edge triggered when edge is true */
+static VALUE poller_add(VALUE self, VALUE rb_fd, VALUE edge) {
+  CHECK_TYPE(rb_fd, T_FIXNUM);
+
+  poller_ctl(poller_get(self), EPOLL_CTL_ADD, FIX2INT(rb_fd), EPOLLIN | (RTEST(edge) ? EPOLLET : 0));
+
+  return Qnil;
+}
+
+/* Stops watching fd. Closed fds are dropped by epoll on their own. */
+static VALUE poller_remove(VALUE self, VALUE rb_fd) {
+  struct epoll_event ev;
+
+  CHECK_TYPE(rb_fd, T_FIXNUM);
+
+  memset(&ev, 0, sizeof(ev));
+
+  if (epoll_ctl(poller_get(self)->epfd, EPOLL_CTL_DEL, FIX2INT(rb_fd), &ev) < 0) {
+    if (errno != ENOENT && errno != EBADF) {
+      rb_sys_fail("epoll_ctl");
+    }
+  }
+
+  return Qnil;
+}
+
+/* Arms a timer firing every interval milliseconds */
+static VALUE poller_timer(VALUE self, VALUE rb_interval) {
+  long interval;
+  struct itimerspec spec;
+  poller_t* poller = poller_get(self);
+
+  CHECK_NUMERIC(rb_interval);
+
+  if ((interval = NUM2LONG(rb_interval)) <= 0) {
+    rb_raise(rb_eArgError, "interval must be positive; interval=%ld", interval);
+  }
+
+  if (poller->timerfd < 0) {
+    if ((poller->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0) {
+      rb_sys_fail("timerfd_create");
+    }
+
+    poller_ctl(poller, EPOLL_CTL_ADD, poller->timerfd, EPOLLIN);
+  }
+
+  spec.it_interval.tv_sec = interval / 1000;
+  spec.it_interval.tv_nsec = (interval % 1000) * 1000000;
+  spec.it_value = spec.it_interval;
+
+  if (timerfd_settime(poller->timerfd, 0, &spec, NULL) < 0) {
+    rb_sys_fail("timerfd_settime");
+  }
+
+  return Qnil;
+}
+
+static void* poller_wait_without_gvl(void* ptr) {
+  poller_wait_t* call = (poller_wait_t*) ptr;
+
+  call->n = epoll_wait(call->poller->epfd, call->poller->events, POLLER_MAX_EVENTS, -1);
+  call->err = errno;
+
+  return NULL;
+}
+
+/*
+ * Waits until a watched fd is readable or the timer fires. Appends every
+ * readable fd to `ready` and returns the number of timer expirations since
+ * the last wait. Returns 0 with nothing appended when interrupted, after
+ * running any pending signal handlers.
+ */
+static VALUE poller_wait(VALUE self, VALUE ready) {
+  int i, fd;
+  uint64_t expirations = 0, count;
+  poller_wait_t call;
+  poller_t* poller = poller_get(self);
+
+  CHECK_TYPE(ready, T_ARRAY);
+
+  call.poller = poller;
+  call.n = 0;
+  call.err = 0;
+
+  sk_without_gvl(poller_wait_without_gvl, &call, RUBY_UBF_IO, NULL);
+
+  if (call.n < 0) {
+    if (call.err != EINTR) {
+      errno = call.err;
+      rb_sys_fail("epoll_wait");
+    }
+
+    rb_thread_check_ints();
+    return INT2FIX(0);
+  }
+
+  for (i = 0; i < call.n; ++i) {
+    fd = poller->events[i].data.fd;
+
+    if (fd == poller->timerfd) {
+      if (read(fd, &count, sizeof(count)) == sizeof(count)) {
+        expirations += count;
+      }
+    }
+    else {
+      rb_ary_push(ready, INT2FIX(fd));
+    }
+  }
+
+  return ULL2NUM(expirations);
+}
+
+static VALUE poller_close(VALUE self) {
+  poller_t* poller;
+  Data_Get_Struct(self, poller_t, poller);
+  poller_close_fds(poller);
+  return Qnil;
+}
+
+void Init_skylight_poller(void) {
+  rb_cPoller = rb_define_class_under(rb_mSkylight, "Poller", rb_cObject);
+  rb_define_singleton_method(rb_cPoller, "native_new", poller_new, 0);
+  rb_define_method(rb_cPoller, "native_add", poller_add, 2);
+  rb_define_method(rb_cPoller, "native_remove", poller_remove, 1);
+  rb_define_method(rb_cPoller, "native_timer", poller_timer, 1);
+  rb_define_method(rb_cPoller, "native_wait", poller_wait, 1);
+  rb_define_method(rb_cPoller, "native_close", poller_close, 0);
+}
+
+#else
+
+void Init_skylight_poller(void) {
+}
+
+#endif
@@ -0,0 +1,282 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <skylight_native.h>
+
+/**
+ * Process sampler
+ *
+ * Reads the worker's own resource usage out of /proc/self/statm,
+ * /proc/self/stat and /proc/stat. Each file is read into a buffer
+ * allocated with the sampler and parsed in place, and the values are kept
+ * as integers until asked for, so sampling allocates nothing, in C or
+ * Ruby, and never forks.
+ *
+ * Context switches come from getrusage, which has them without a file to
+ * parse. Sampling fails where /proc is missing, so callers can fall back
+ * to another way of measuring.
+ */
+
+#define PROC_BUF_SIZE 4096
+
+typedef struct {
+  char* buf;
+
+  /* /proc/self/statm, in bytes */
+  uint64_t rss;
+
+  /* /proc/self/stat, times in clock ticks */
+  uint64_t minor_faults;
+  uint64_t major_faults;
+  uint64_t utime;
+  uint64_t stime;
+  uint64_t threads;
+
+  /* The aggregate cpu line of /proc/stat, in clock ticks */
+  uint64_t cpu_usage;
+  uint64_t cpu_total;
+
+  uint64_t voluntary_switches;
+  uint64_t involuntary_switches;
+  uint64_t open_fds;
+} proc_sampler_t;
+
+static VALUE rb_cProcSampler;
+
+static void proc_free(proc_sampler_t* sampler) {
+  free(sampler->buf);
+  free(sampler);
+}
+
+static proc_sampler_t* proc_get(VALUE self) {
+  proc_sampler_t* sampler;
+  Data_Get_Struct(self, proc_sampler_t, sampler);
+  return sampler;
+}
+
+static VALUE proc_new(VALUE klass) {
+  proc_sampler_t* sampler;
+
+  if (!(sampler = malloc(sizeof(proc_sampler_t)))) {
+    rb_memerror();
+  }
+
+  memset(sampler, 0, sizeof(proc_sampler_t));
+
+  if (!(sampler->buf = malloc(PROC_BUF_SIZE))) {
+    proc_free(sampler);
+    rb_memerror();
+  }
+
+  return Data_Wrap_Struct(rb_cProcSampler, NULL, proc_free, sampler);
+}
+
+/*
+ * Reads the start of the file into the sampler's buffer, NUL terminated.
+ * Returns false if it could not be read.
+ */
+static bool proc_read(proc_sampler_t* sampler, const char* path) {
+  int fd;
+  ssize_t len;
+
+  do {
+    fd = open(path, O_RDONLY);
+  } while (fd < 0 && errno == EINTR);
+
+  if (fd < 0) {
+    return false;
+  }
+
+  do {
+    len = read(fd, sampler->buf, PROC_BUF_SIZE - 1);
+  } while (len < 0 && errno == EINTR);
+
+  close(fd);
+
+  if (len <= 0) {
+    return false;
+  }
+
+  sampler->buf[len] = '\0';
+
+  return true;
+}
+
+/* Parses the unsigned integer at *pos, moving past it and any spaces */
+static uint64_t proc_parse(const char** pos) {
+  const char* p = *pos;
+  uint64_t val = 0;
+
+  while (*p == ' ') {
+    ++p;
+  }
+
+  while (*p >= '0' && *p <= '9') {
+    val = val * 10 + (*p++ - '0');
+  }
+
+  *pos = p;
+
+  return val;
+}
+
+/* Moves past n space separated fields */
+static const char* proc_skip(const char* p, int n) {
+  while (n-- > 0) {
+    while (*p == ' ') {
+      ++p;
+    }
+
+    while (*p && *p != ' ') {
+      ++p;
+    }
+  }
+
+  return p;
+}
+
+/* Resident pages are the second field */
+static bool proc_sample_statm(proc_sampler_t* sampler) {
+  const char* p;
+
+  if (!proc_read(sampler, "/proc/self/statm")) {
+    return false;
+  }
+
+  p = proc_skip(sampler->buf, 1);
+  sampler->rss = proc_parse(&p) * (uint64_t) sysconf(_SC_PAGESIZE);
+
+  return true;
+}
+
+/*
+ * The command name, in parentheses, may contain spaces, so fields are
+ * counted from the last closing parenthesis, where field 3, the state,
+ * starts
+ */
+static bool proc_sample_stat(proc_sampler_t* sampler) {
+  const char* p;
+
+  if (!proc_read(sampler, "/proc/self/stat") || !(p = strrchr(sampler->buf, ')'))) {
+    return false;
+  }
+
+  /* Fields 10, 12, 14, 15 and 20 */
+  p = proc_skip(p + 1, 7);
+  sampler->minor_faults = proc_parse(&p);
+  p = proc_skip(p, 1);
+  sampler->major_faults = proc_parse(&p);
+  p = proc_skip(p, 1);
+  sampler->utime = proc_parse(&p);
+  sampler->stime = proc_parse(&p);
+  p = proc_skip(p, 4);
+  sampler->threads = proc_parse(&p);
+
+  return true;
+}
+
+/* "cpu  user nice system idle ..." */
+static bool proc_sample_cpu(proc_sampler_t* sampler) {
+  const char* p;
+  uint64_t usage;
+
+  if (!proc_read(sampler, "/proc/stat") || strncmp(sampler->buf, "cpu ", 4) != 0) {
+    return false;
+  }
+
+  p = sampler->buf + 4;
+  usage = proc_parse(&p);
+  usage += proc_parse(&p);
+  usage += proc_parse(&p);
+
+  sampler->cpu_usage = usage;
+  sampler->cpu_total = usage + proc_parse(&p);
+
+  return true;
+}
+
+static void proc_sample_rusage(proc_sampler_t* sampler) {
+  struct rusage usage;
+
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+    sampler->voluntary_switches = (uint64_t) usage.ru_nvcsw;
+    sampler->involuntary_switches = (uint64_t) usage.ru_nivcsw;
+  }
+}
+
+/* Not counting the descriptor opendir holds, nor . and .. */
+static void proc_sample_fds(proc_sampler_t* sampler) {
+  DIR* dir;
+  struct dirent* entry;
+  uint64_t count = 0;
+
+  if (!(dir = opendir("/proc/self/fd"))) {
+    return;
+  }
+
+  while ((entry = readdir(dir))) {
+    if (entry->d_name[0] != '.') {
+      ++count;
+    }
+  }
+
+  closedir(dir);
+
+  sampler->open_fds = count > 0 ? count - 1 : 0;
+}
+
+/*
+ * Takes a new sample. Returns false, leaving the previous values, if /proc
+ * could not be read.
+ */
+static VALUE proc_sample(VALUE self) {
+  proc_sampler_t* sampler = proc_get(self);
+
+  if (!proc_sample_statm(sampler) || !proc_sample_stat(sampler) || !proc_sample_cpu(sampler)) {
+    return Qfalse;
+  }
+
+  proc_sample_rusage(sampler);
+  proc_sample_fds(sampler);
+
+  return Qtrue;
+}
+
+#define PROC_READER(field)                          \
+  static VALUE proc_ ## field(VALUE self) {         \
+    return ULL2NUM(proc_get(self)->field);          \
+  }
+
+PROC_READER(rss)
+PROC_READER(minor_faults)
+PROC_READER(major_faults)
+PROC_READER(utime)
+PROC_READER(stime)
+PROC_READER(threads)
+PROC_READER(cpu_usage)
+PROC_READER(cpu_total)
+PROC_READER(voluntary_switches)
+PROC_READER(involuntary_switches)
+PROC_READER(open_fds)
+
+void Init_skylight_proc(void) {
+  rb_cProcSampler = rb_define_class_under(rb_mSkylight, "ProcSampler", rb_cObject);
+  rb_define_singleton_method(rb_cProcSampler, "native_new", proc_new, 0);
+  rb_define_method(rb_cProcSampler, "native_sample", proc_sample, 0);
+  rb_define_method(rb_cProcSampler, "native_rss", proc_rss, 0);
+  rb_define_method(rb_cProcSampler, "native_minor_faults", proc_minor_faults, 0);
+  rb_define_method(rb_cProcSampler, "native_major_faults", proc_major_faults, 0);
+  rb_define_method(rb_cProcSampler, "native_utime", proc_utime, 0);
+  rb_define_method(rb_cProcSampler, "native_stime", proc_stime, 0);
+  rb_define_method(rb_cProcSampler, "native_threads", proc_threads, 0);
+  rb_define_method(rb_cProcSampler, "native_cpu_usage", proc_cpu_usage, 0);
+  rb_define_method(rb_cProcSampler, "native_cpu_total", proc_cpu_total, 0);
+  rb_define_method(rb_cProcSampler, "native_voluntary_switches", proc_voluntary_switches, 0);
+  rb_define_method(rb_cProcSampler, "native_involuntary_switches", proc_involuntary_switches, 0);
+  rb_define_method(rb_cProcSampler, "native_open_fds", proc_open_fds, 0);
+}
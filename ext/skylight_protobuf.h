@@ -0,0 +1,226 @@
+#ifndef __SKYLIGHT_PROTOBUF_H__
+#define __SKYLIGHT_PROTOBUF_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/**
+ * Minimal protobuf wire format helpers for the messages that are assembled
+ * in the extension rather than by libskylight. Only varint and
+ * length-delimited fields can be written; any field can be skipped when
+ * reading.
+ */
+
+#define PB_VARINT  0
+#define PB_FIXED64 1
+#define PB_BYTES   2
+#define PB_FIXED32 5
+
+#define PB_TAG(field, type) ((uint64_t) (((field) << 3) | (type)))
+
+static inline size_t pb_varint_size(uint64_t val) {
+  size_t size = 1;
+
+  while (val >= 0x80) {
+    val >>= 7;
+    size++;
+  }
+
+  return size;
+}
+
+/* Size of a length-delimited field with a payload of len bytes */
+static inline size_t pb_bytes_size(int field, size_t len) {
+  return pb_varint_size(PB_TAG(field, PB_BYTES)) + pb_varint_size(len) + len;
+}
+
+/* Size of a varint field */
+static inline size_t pb_uint_size(int field, uint64_t val) {
+  return pb_varint_size(PB_TAG(field, PB_VARINT)) + pb_varint_size(val);
+}
+
+/*
+ * Writes into a buffer that the caller has sized up front using the
+ * pb_*_size helpers.
+ */
+typedef struct {
+  uint8_t* pos;
+  uint8_t* end;
+} pb_writer_t;
+
+static inline void pb_write_varint(pb_writer_t* w, uint64_t val) {
+  while (val >= 0x80) {
+    *w->pos++ = (uint8_t) (val | 0x80);
+    val >>= 7;
+  }
+
+  *w->pos++ = (uint8_t) val;
+}
+
+static inline void pb_write_raw(pb_writer_t* w, const void* data, size_t len) {
+  memcpy(w->pos, data, len);
+  w->pos += len;
+}
+
+/* Writes the tag and length of a length-delimited field, but not its payload */
+static inline void pb_write_header(pb_writer_t* w, int field, size_t len) {
+  pb_write_varint(w, PB_TAG(field, PB_BYTES));
+  pb_write_varint(w, len);
+}
+
+static inline void pb_write_bytes(pb_writer_t* w, int field, const void* data, size_t len) {
+  pb_write_header(w, field, len);
+  pb_write_raw(w, data, len);
+}
+
+static inline void pb_write_uint(pb_writer_t* w, int field, uint64_t val) {
+  pb_write_varint(w, PB_TAG(field, PB_VARINT));
+  pb_write_varint(w, val);
+}
+
+/*
+ * Reads fields out of a serialized message without decoding it. All
+ * functions return false on malformed input.
+ */
+typedef struct {
+  const uint8_t* pos;
+  const uint8_t* end;
+} pb_reader_t;
+
+static inline void pb_reader_init(pb_reader_t* r, const void* data, size_t len) {
+  r->pos = (const uint8_t*) data;
+  r->end = r->pos + len;
+}
+
+static inline bool pb_read_varint(pb_reader_t* r, uint64_t* val) {
+  int shift = 0;
+  uint8_t byte;
+
+  *val = 0;
+
+  while (r->pos < r->end && shift < 64) {
+    byte = *r->pos++;
+    *val |= ((uint64_t) (byte & 0x7f)) << shift;
+
+    if (!(byte & 0x80)) {
+      return true;
+    }
+
+    shift += 7;
+  }
+
+  return false;
+}
+
+static inline bool pb_read_tag(pb_reader_t* r, uint32_t* field, uint32_t* type) {
+  uint64_t tag;
+
+  if (!pb_read_varint(r, &tag)) {
+    return false;
+  }
+
+  *field = (uint32_t) (tag >> 3);
+  *type = (uint32_t) (tag & 7);
+
+  return true;
+}
+
+/* Reads the payload of a length-delimited field */
+static inline bool pb_read_bytes(pb_reader_t* r, const uint8_t** data, size_t* len) {
+  uint64_t size;
+
+  if (!pb_read_varint(r, &size) || size > (uint64_t) (r->end - r->pos)) {
+    return false;
+  }
+
+  *data = r->pos;
+  *len = (size_t) size;
+  r->pos += size;
+
+  return true;
+}
+
+/* Skips the payload of a field of the given wire type */
+static inline bool pb_skip(pb_reader_t* r, uint32_t type) {
+  uint64_t val;
+  const uint8_t* data;
+  size_t len;
+
+  switch (type) {
+    case PB_VARINT:
+      return pb_read_varint(r, &val);
+    case PB_BYTES:
+      return pb_read_bytes(r, &data, &len);
+    case PB_FIXED64:
+      len = 8;
+      break;
+    case PB_FIXED32:
+      len = 4;
+      break;
+    default:
+      return false;
+  }
+
+  if (len > (size_t) (r->end - r->pos)) {
+    return false;
+  }
+
+  r->pos += len;
+  return true;
+}
+
+/*
+ * Finds the first length-delimited field with the given number in a message.
+ */
+static inline bool pb_find_bytes(const void* msg, size_t msg_len, uint32_t field, const uint8_t** data, size_t* len) {
+  pb_reader_t r;
+  uint32_t f, type;
+
+  pb_reader_init(&r, msg, msg_len);
+
+  while (r.pos < r.end) {
+    if (!pb_read_tag(&r, &f, &type)) {
+      return false;
+    }
+
+    if (f == field && type == PB_BYTES) {
+      return pb_read_bytes(&r, data, len);
+    }
+
+    if (!pb_skip(&r, type)) {
+      return false;
+    }
+  }
+
+  return false;
+}
+
+/*
+ * Finds the first varint field with the given number in a message.
+ */
+static inline bool pb_find_uint(const void* msg, size_t msg_len, uint32_t field, uint64_t* val) {
+  pb_reader_t r;
+  uint32_t f, type;
+
+  pb_reader_init(&r, msg, msg_len);
+
+  while (r.pos < r.end) {
+    if (!pb_read_tag(&r, &f, &type)) {
+      return false;
+    }
+
+    if (f == field && type == PB_VARINT) {
+      return pb_read_varint(&r, val);
+    }
+
+    if (!pb_skip(&r, type)) {
+      return false;
+    }
+  }
+
+  return false;
+}
+
+#endif
@@ -0,0 +1,356 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <skylight_native.h>
+
+/**
+ * MPSC queue
+ *
+ * A bounded queue of Ruby objects that any number of threads push to and a
+ * single thread pops from. Slots carry sequence numbers: a producer claims
+ * a slot by advancing `tail` with a compare and swap, stores its object and
+ * then publishes it by bumping the slot's sequence. Pushing never takes a
+ * lock unless the consumer is asleep.
+ *
+ * The consumer sleeps on a condition variable with the GVL released. It
+ * sets `waiting` before checking the queue one last time, and producers
+ * check `waiting` after publishing, with full barriers in between, so a
+ * push can never be missed.
+ */
+
+typedef struct {
+  volatile uint64_t seq;
+  VALUE value;
+} queue_slot_t;
+
+typedef struct {
+  queue_slot_t* slots;
+  uint64_t size;
+
+  volatile uint64_t tail;
+  volatile uint64_t head;
+
+  volatile int waiting;
+  int interrupted;
+  bool popping;
+  pid_t pid;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+
+  volatile uint64_t drops;
+  volatile uint64_t high_water;
+} queue_t;
+
+typedef struct {
+  queue_t* queue;
+  bool forever;
+  struct timespec deadline;
+} queue_wait_t;
+
+static VALUE rb_cMpscQueue;
+
+static void queue_mark(queue_t* queue) {
+  uint64_t i;
+
+  for (i = 0; i < queue->size; ++i) {
+    rb_gc_mark(queue->slots[i].value);
+  }
+}
+
+static void queue_free(queue_t* queue) {
+  pthread_cond_destroy(&queue->cond);
+  pthread_mutex_destroy(&queue->lock);
+  free(queue->slots);
+  free(queue);
+}
+
+static queue_t* queue_get(VALUE self) {
+  queue_t* queue;
+  Data_Get_Struct(self, queue_t, queue);
+  return queue;
+}
+
+static VALUE queue_new(VALUE klass, VALUE rb_size) {
+  long size;
+  uint64_t i;
+  queue_t* queue;
+
+  CHECK_NUMERIC(rb_size);
+
+  if ((size = NUM2LONG(rb_size)) <= 0) {
+    rb_raise(rb_eArgError, "queue size must be positive");
+  }
+
+  if (!(queue = malloc(sizeof(queue_t)))) {
+    rb_memerror();
+  }
+
+  memset(queue, 0, sizeof(queue_t));
+
+  if (!(queue->slots = malloc(size * sizeof(queue_slot_t)))) {
+    free(queue);
+    rb_memerror();
+  }
+
+  queue->size = size;
+  queue->pid = getpid();
+
+  for (i = 0; i < queue->size; ++i) {
+    queue->slots[i].seq = i;
+    queue->slots[i].value = Qnil;
+  }
+
+  pthread_mutex_init(&queue->lock, NULL);
+  pthread_cond_init(&queue->cond, NULL);
+
+  return Data_Wrap_Struct(rb_cMpscQueue, queue_mark, queue_free, queue);
+}
+
+static bool queue_ready(queue_t* queue) {
+  uint64_t head = queue->head;
+  return queue->slots[head % queue->size].seq == head + 1;
+}
+
+/* Only ever called by the consumer */
+static bool queue_shift(queue_t* queue, VALUE* ret) {
+  uint64_t head = queue->head;
+  queue_slot_t* slot = &queue->slots[head % queue->size];
+
+  if (slot->seq != head + 1) {
+    return false;
+  }
+
+  /* Don't read the object before seeing the sequence that published it */
+  __sync_synchronize();
+
+  *ret = slot->value;
+  slot->value = Qnil;
+
+  /* Done with the slot before handing it back to the producers */
+  __sync_synchronize();
+
+  slot->seq = head + queue->size;
+  queue->head = head + 1;
+
+  return true;
+}
+
+/*
+ * Returns the number of items in the queue or nil if the queue is full
+ */
+static VALUE queue_push(VALUE self, VALUE obj) {
+  int64_t diff;
+  uint64_t pos, head, len, high;
+  queue_slot_t* slot;
+  queue_t* queue = queue_get(self);
+
+  pos = queue->tail;
+
+  while (1) {
+    slot = &queue->slots[pos % queue->size];
+    diff = (int64_t) (slot->seq - pos);
+
+    if (diff == 0) {
+      if (__sync_bool_compare_and_swap(&queue->tail, pos, pos + 1)) {
+        break;
+      }
+    }
+    else if (diff < 0) {
+      __sync_fetch_and_add(&queue->drops, 1);
+      return Qnil;
+    }
+
+    pos = queue->tail;
+  }
+
+  slot->value = obj;
+
+  /* The object must be visible before the sequence is */
+  __sync_synchronize();
+  slot->seq = pos + 1;
+
+  head = queue->head;
+  len = queue->tail - head;
+
+  while ((high = queue->high_water) < len) {
+    if (__sync_bool_compare_and_swap(&queue->high_water, high, len)) {
+      break;
+    }
+  }
+
+  /* Publish before checking for a sleeping consumer */
+  __sync_synchronize();
+
+  /*
+   * The lock is only taken when there is a consumer to wake, and never in a
+   * forked child, where the consumer thread does not exist and the lock may
+   * have been held at the time of the fork.
+   */
+  if (queue->waiting && queue->pid == getpid()) {
+    pthread_mutex_lock(&queue->lock);
+    pthread_cond_signal(&queue->cond);
+    pthread_mutex_unlock(&queue->lock);
+  }
+
+  return ULL2NUM(len);
+}
+
+static void* queue_wait(void* data) {
+  queue_wait_t* wait = (queue_wait_t*) data;
+  queue_t* queue = wait->queue;
+
+  pthread_mutex_lock(&queue->lock);
+
+  queue->waiting = 1;
+  __sync_synchronize();
+
+  while (!queue->interrupted && !queue_ready(queue)) {
+    if (wait->forever) {
+      pthread_cond_wait(&queue->cond, &queue->lock);
+    }
+    else if (pthread_cond_timedwait(&queue->cond, &queue->lock, &wait->deadline) == ETIMEDOUT) {
+      break;
+    }
+  }
+
+  queue->waiting = 0;
+  queue->interrupted = 0;
+
+  pthread_mutex_unlock(&queue->lock);
+
+  return NULL;
+}
+
+static void queue_unblock(void* data) {
+  queue_t* queue = ((queue_wait_t*) data)->queue;
+
+  pthread_mutex_lock(&queue->lock);
+  queue->interrupted = 1;
+  pthread_cond_signal(&queue->cond);
+  pthread_mutex_unlock(&queue->lock);
+}
+
+static bool queue_expired(queue_wait_t* wait) {
+  struct timeval now;
+
+  if (wait->forever) {
+    return false;
+  }
+
+  gettimeofday(&now, NULL);
+
+  return now.tv_sec > wait->deadline.tv_sec ||
+    (now.tv_sec == wait->deadline.tv_sec && now.tv_usec * 1000 >= wait->deadline.tv_nsec);
+}
+
+/*
+ * Pops the next item, waiting up to `timeout` seconds (forever when nil)
+ * for one to be pushed. Returns nil on timeout, or right away if another
+ * thread is already waiting.
+ */
+static VALUE queue_pop(int argc, VALUE* argv, VALUE self) {
+  VALUE timeout, ret;
+  double secs = 0;
+  struct timeval now;
+  queue_wait_t wait;
+  queue_t* queue = queue_get(self);
+
+  rb_scan_args(argc, argv, "01", &timeout);
+
+  if (!NIL_P(timeout)) {
+    if ((secs = NUM2DBL(timeout)) < 0) {
+      rb_raise(rb_eArgError, "timeout must be nil or >= than 0");
+    }
+  }
+
+  if (queue_shift(queue, &ret)) {
+    return ret;
+  }
+
+  if ((!NIL_P(timeout) && secs == 0) || queue->popping) {
+    return Qnil;
+  }
+
+  wait.queue = queue;
+  wait.forever = NIL_P(timeout);
+
+  if (!wait.forever) {
+    gettimeofday(&now, NULL);
+    secs += now.tv_sec + now.tv_usec / 1e6;
+
+    wait.deadline.tv_sec = (time_t) secs;
+    wait.deadline.tv_nsec = (long) ((secs - wait.deadline.tv_sec) * 1e9);
+  }
+
+  while (1) {
+    queue->popping = true;
+    sk_without_gvl(queue_wait, &wait, queue_unblock, &wait);
+    queue->popping = false;
+
+    if (queue_shift(queue, &ret)) {
+      return ret;
+    }
+
+    if (queue_expired(&wait)) {
+      return Qnil;
+    }
+
+    /* Woken up to handle an interrupt, e.g. Thread#kill */
+    rb_thread_check_ints();
+  }
+}
+
+/*
+ * Removes and returns up to `max` items without blocking
+ */
+static VALUE queue_drain(VALUE self, VALUE rb_max) {
+  long i, max;
+  VALUE obj, ret;
+  queue_t* queue = queue_get(self);
+
+  CHECK_NUMERIC(rb_max);
+
+  max = NUM2LONG(rb_max);
+  ret = rb_ary_new();
+
+  for (i = 0; i < max && queue_shift(queue, &obj); ++i) {
+    rb_ary_push(ret, obj);
+  }
+
+  return ret;
+}
+
+static VALUE queue_length(VALUE self) {
+  queue_t* queue = queue_get(self);
+  uint64_t head = queue->head;
+  return ULL2NUM(queue->tail - head);
+}
+
+static VALUE queue_empty_p(VALUE self) {
+  return queue_ready(queue_get(self)) ? Qfalse : Qtrue;
+}
+
+/* Number of pushes rejected because the queue was full */
+static VALUE queue_drops(VALUE self) {
+  return ULL2NUM(queue_get(self)->drops);
+}
+
+/* Largest number of items the queue has held */
+static VALUE queue_high_water(VALUE self) {
+  return ULL2NUM(queue_get(self)->high_water);
+}
+
+void Init_skylight_queue(void) {
+  rb_cMpscQueue = rb_define_class_under(rb_mSkylight, "MpscQueue", rb_cObject);
+  rb_define_singleton_method(rb_cMpscQueue, "native_new", queue_new, 1);
+  rb_define_method(rb_cMpscQueue, "native_push", queue_push, 1);
+  rb_define_method(rb_cMpscQueue, "native_pop", queue_pop, -1);
+  rb_define_method(rb_cMpscQueue, "native_drain", queue_drain, 1);
+  rb_define_method(rb_cMpscQueue, "native_length", queue_length, 0);
+  rb_define_method(rb_cMpscQueue, "native_empty?", queue_empty_p, 0);
+  rb_define_method(rb_cMpscQueue, "native_drops", queue_drops, 0);
+  rb_define_method(rb_cMpscQueue, "native_high_water", queue_high_water, 0);
+}
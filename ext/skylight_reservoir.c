@@ -0,0 +1,541 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <skylight_native.h>
+#include <skylight_protobuf.h>
+
+#define ARENA_MIN_CAPA (64 * 1024)
+
+/**
+ * Reservoir
+ *
+ * Samples serialized traces. The bytes of every sampled trace live in a
+ * single arena; replaced traces leave holes that are reclaimed whenever the
+ * arena has to grow, so it stays within roughly twice the size of the live
+ * sample.
+ *
+ * The uniform mode uses Algorithm L, which draws random numbers only for
+ * the traces that end up being kept. The weighted mode uses A-Res, keyed by
+ * the duration of the root span, so slow traces are kept more often.
+ *
+ * Random numbers come from Ruby's generator, which needs the GVL, unless
+ * the reservoir was seeded with a generator of its own.
+ */
+
+/* [0, 1) */
+static double reservoir_real(sk_reservoir_t* reservoir) {
+  uint64_t x;
+
+  if (!reservoir->rng) {
+    return rb_genrand_real();
+  }
+
+  /* xorshift64* */
+  x = reservoir->rng;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  reservoir->rng = x;
+
+  return (double) ((x * 2685821657736338717ULL) >> 11) / 9007199254740992.0;
+}
+
+static double reservoir_random(sk_reservoir_t* reservoir) {
+  /* (0, 1] so that log() is always finite */
+  return 1.0 - reservoir_real(reservoir);
+}
+
+/* Number of traces Algorithm L skips before the next replacement */
+static uint64_t reservoir_skip(sk_reservoir_t* reservoir) {
+  double skip = floor(log(reservoir_random(reservoir)) / log(1.0 - reservoir->w));
+
+  if (!(skip < 1e18)) {
+    return (uint64_t) 1e18;
+  }
+
+  return (uint64_t) skip;
+}
+
+void sk_reservoir_init(sk_reservoir_t* reservoir, long size, bool weighted) {
+  memset(reservoir, 0, sizeof(sk_reservoir_t));
+  reservoir->size = size;
+  reservoir->weighted = weighted;
+}
+
+void sk_reservoir_destroy(sk_reservoir_t* reservoir) {
+  uint64_t rng = reservoir->rng;
+
+  free(reservoir->samples);
+  free(reservoir->arena);
+
+  sk_reservoir_init(reservoir, reservoir->size, reservoir->weighted);
+  reservoir->rng = rng;
+}
+
+void sk_reservoir_seed(sk_reservoir_t* reservoir, uint64_t seed) {
+  reservoir->rng = seed;
+}
+
+void sk_reservoir_clear(sk_reservoir_t* reservoir) {
+  reservoir->len = 0;
+  reservoir->count = 0;
+  reservoir->arena_len = 0;
+  reservoir->arena_live = 0;
+}
+
+/*
+ * Copies the live samples into a fresh arena with room for at least `len`
+ * more bytes.
+ */
+static bool reservoir_compact(sk_reservoir_t* reservoir, size_t len) {
+  long i;
+  size_t capa, pos = 0;
+  char* arena;
+
+  capa = (reservoir->arena_live + len) * 2;
+
+  if (capa < ARENA_MIN_CAPA) {
+    capa = ARENA_MIN_CAPA;
+  }
+
+  if (!(arena = malloc(capa))) {
+    return false;
+  }
+
+  for (i = 0; i < reservoir->len; ++i) {
+    memcpy(arena + pos, reservoir->arena + reservoir->samples[i].offset, reservoir->samples[i].len);
+    reservoir->samples[i].offset = pos;
+    pos += reservoir->samples[i].len;
+  }
+
+  free(reservoir->arena);
+  reservoir->arena = arena;
+  reservoir->arena_len = pos;
+  reservoir->arena_capa = capa;
+
+  return true;
+}
+
+/* Stores a trace in slot i, which must not hold any live bytes */
+static bool reservoir_store(sk_reservoir_t* reservoir, long i, const void* data, size_t len, double key) {
+  if (len > reservoir->arena_capa - reservoir->arena_len) {
+    if (!reservoir_compact(reservoir, len)) {
+      return false;
+    }
+  }
+
+  memcpy(reservoir->arena + reservoir->arena_len, data, len);
+
+  reservoir->samples[i].offset = reservoir->arena_len;
+  reservoir->samples[i].len = len;
+  reservoir->samples[i].key = key;
+
+  reservoir->arena_len += len;
+  reservoir->arena_live += len;
+
+  return true;
+}
+
+static void reservoir_release(sk_reservoir_t* reservoir, long i) {
+  reservoir->arena_live -= reservoir->samples[i].len;
+  reservoir->samples[i].len = 0;
+}
+
+/* In weighted mode the samples form a min-heap on their keys */
+static void reservoir_swap(sk_reservoir_t* reservoir, long a, long b) {
+  sk_sample_t tmp = reservoir->samples[a];
+  reservoir->samples[a] = reservoir->samples[b];
+  reservoir->samples[b] = tmp;
+}
+
+static void reservoir_sift_up(sk_reservoir_t* reservoir, long i) {
+  long parent;
+
+  while (i > 0) {
+    parent = (i - 1) / 2;
+
+    if (reservoir->samples[parent].key <= reservoir->samples[i].key) {
+      break;
+    }
+
+    reservoir_swap(reservoir, parent, i);
+    i = parent;
+  }
+}
+
+static void reservoir_sift_down(sk_reservoir_t* reservoir, long i) {
+  long child;
+
+  while ((child = i * 2 + 1) < reservoir->len) {
+    if (child + 1 < reservoir->len && reservoir->samples[child + 1].key < reservoir->samples[child].key) {
+      child++;
+    }
+
+    if (reservoir->samples[i].key <= reservoir->samples[child].key) {
+      break;
+    }
+
+    reservoir_swap(reservoir, i, child);
+    i = child;
+  }
+}
+
+/* Weight of a serialized trace: the duration of its root span */
+static double reservoir_weight(const void* trace, size_t len) {
+  uint64_t duration = 0;
+
+  sk_trace_duration(trace, len, &duration);
+
+  return (double) duration + 1.0;
+}
+
+/* Keeps the traces with the largest keys */
+static int reservoir_offer(sk_reservoir_t* reservoir, const void* data, size_t len, double key) {
+  long i;
+
+  if (reservoir->len < reservoir->size) {
+    i = reservoir->len++;
+    reservoir->samples[i].len = 0;
+
+    if (!reservoir_store(reservoir, i, data, len, key)) {
+      reservoir->len--;
+      return -1;
+    }
+
+    reservoir_sift_up(reservoir, i);
+    return 1;
+  }
+
+  if (key <= reservoir->samples[0].key) {
+    return 0;
+  }
+
+  reservoir_release(reservoir, 0);
+
+  if (!reservoir_store(reservoir, 0, data, len, key)) {
+    /* Drop the slot rather than leave a hole in the sample */
+    reservoir->samples[0] = reservoir->samples[--reservoir->len];
+    reservoir_sift_down(reservoir, 0);
+    return -1;
+  }
+
+  reservoir_sift_down(reservoir, 0);
+  return 1;
+}
+
+/* Algorithm L's state once the sample first fills up */
+static void reservoir_start_skipping(sk_reservoir_t* reservoir) {
+  reservoir->w = exp(log(reservoir_random(reservoir)) / reservoir->size);
+  reservoir->next = reservoir->count + reservoir_skip(reservoir) + 1;
+}
+
+int sk_reservoir_push(sk_reservoir_t* reservoir, const void* data, size_t len) {
+  long i;
+
+  reservoir->count++;
+
+  if (reservoir->size <= 0) {
+    return 0;
+  }
+
+  if (!reservoir->samples) {
+    if (!(reservoir->samples = malloc(reservoir->size * sizeof(sk_sample_t)))) {
+      return -1;
+    }
+  }
+
+  if (reservoir->weighted) {
+    /* A-Res: keep the traces with the largest u ^ (1 / weight) */
+    return reservoir_offer(reservoir, data, len, log(reservoir_random(reservoir)) / reservoir_weight(data, len));
+  }
+
+  if (reservoir->len < reservoir->size) {
+    i = reservoir->len++;
+    reservoir->samples[i].len = 0;
+
+    if (!reservoir_store(reservoir, i, data, len, 0)) {
+      reservoir->len--;
+      return -1;
+    }
+
+    if (reservoir->len == reservoir->size) {
+      reservoir_start_skipping(reservoir);
+    }
+
+    return 1;
+  }
+
+  if (reservoir->count < reservoir->next) {
+    return 0;
+  }
+
+  i = (long) (reservoir_real(reservoir) * reservoir->size);
+
+  if (i >= reservoir->size) {
+    i = reservoir->size - 1;
+  }
+
+  reservoir_release(reservoir, i);
+
+  reservoir->w *= exp(log(reservoir_random(reservoir)) / reservoir->size);
+  reservoir->next = reservoir->count + reservoir_skip(reservoir) + 1;
+
+  if (!reservoir_store(reservoir, i, data, len, 0)) {
+    /* Drop the slot rather than leave a hole in the sample */
+    reservoir->samples[i] = reservoir->samples[--reservoir->len];
+    return -1;
+  }
+
+  return 1;
+}
+
+/**
+ * Merging
+ *
+ * Weighted samples keep their A-Res keys, so merging them keeps the traces
+ * with the largest keys across all of the reservoirs. Uniform samples are
+ * merged by drawing, without replacement, which reservoir each kept trace
+ * comes from, in proportion to the traces each was offered, then picking
+ * that many of its samples at random.
+ */
+
+static bool reservoir_merge_weighted(sk_reservoir_t* merged, sk_reservoir_t** all, long n) {
+  long i, j;
+  sk_sample_t* sample;
+
+  for (i = 0; i < n; ++i) {
+    for (j = 0; j < all[i]->len; ++j) {
+      sample = &all[i]->samples[j];
+
+      if (reservoir_offer(merged, all[i]->arena + sample->offset, sample->len, sample->key) < 0) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+static bool reservoir_merge_uniform(sk_reservoir_t* merged, sk_reservoir_t** all, long n) {
+  long i, j, k, pick, tmp;
+  long* taken;
+  long* order;
+  uint64_t r, left, remaining = merged->count;
+  sk_sample_t* sample;
+  bool ok = true;
+
+  taken = calloc(n, sizeof(long));
+  order = malloc(merged->size * sizeof(long));
+
+  if (!taken || !order) {
+    free(taken);
+    free(order);
+    return false;
+  }
+
+  for (k = 0; k < merged->size && remaining > 0; ++k, --remaining) {
+    r = (uint64_t) (reservoir_real(merged) * remaining);
+
+    for (i = 0; i < n - 1; ++i) {
+      left = all[i]->count - taken[i];
+
+      if (r < left) {
+        break;
+      }
+
+      r -= left;
+    }
+
+    taken[i]++;
+  }
+
+  for (i = 0; i < n && ok; ++i) {
+    /* Only short when a push ran out of memory */
+    if (taken[i] > all[i]->len) {
+      taken[i] = all[i]->len;
+    }
+
+    for (j = 0; j < all[i]->len; ++j) {
+      order[j] = j;
+    }
+
+    /* A partial shuffle of the source's sample */
+    for (j = 0; j < taken[i] && ok; ++j) {
+      pick = j + (long) (reservoir_real(merged) * (all[i]->len - j));
+
+      if (pick >= all[i]->len) {
+        pick = all[i]->len - 1;
+      }
+
+      tmp = order[j];
+      order[j] = order[pick];
+      order[pick] = tmp;
+
+      sample = &all[i]->samples[order[j]];
+      merged->samples[merged->len].len = 0;
+
+      if ((ok = reservoir_store(merged, merged->len, all[i]->arena + sample->offset, sample->len, 0))) {
+        merged->len++;
+      }
+    }
+  }
+
+  free(taken);
+  free(order);
+
+  if (ok && merged->len == merged->size) {
+    reservoir_start_skipping(merged);
+  }
+
+  return ok;
+}
+
+bool sk_reservoir_merge(sk_reservoir_t* dst, sk_reservoir_t** srcs, long n) {
+  long i;
+  bool ok = true;
+  sk_reservoir_t merged;
+  sk_reservoir_t** all;
+
+  if (!(all = malloc((n + 1) * sizeof(sk_reservoir_t*)))) {
+    return false;
+  }
+
+  all[0] = dst;
+  memcpy(all + 1, srcs, n * sizeof(sk_reservoir_t*));
+
+  sk_reservoir_init(&merged, dst->size, dst->weighted);
+  merged.rng = dst->rng;
+
+  for (i = 0; i <= n; ++i) {
+    merged.count += all[i]->count;
+  }
+
+  if (merged.size > 0) {
+    if (!(merged.samples = malloc(merged.size * sizeof(sk_sample_t)))) {
+      ok = false;
+    }
+    else if (merged.weighted) {
+      ok = reservoir_merge_weighted(&merged, all, n + 1);
+    }
+    else {
+      ok = reservoir_merge_uniform(&merged, all, n + 1);
+    }
+  }
+
+  free(all);
+
+  if (!ok) {
+    sk_reservoir_destroy(&merged);
+    return false;
+  }
+
+  sk_reservoir_destroy(dst);
+  *dst = merged;
+
+  return true;
+}
+
+/**
+ * class Skylight::Reservoir
+ */
+
+static VALUE rb_cReservoir;
+
+static void reservoir_free(sk_reservoir_t* reservoir) {
+  sk_reservoir_destroy(reservoir);
+  free(reservoir);
+}
+
+sk_reservoir_t* sk_reservoir_get(VALUE obj) {
+  sk_reservoir_t* reservoir;
+
+  if (!rb_obj_is_kind_of(obj, rb_cReservoir)) {
+    rb_raise(rb_eArgError, "expected a Skylight::Reservoir but was %s", rb_obj_classname(obj));
+  }
+
+  Data_Get_Struct(obj, sk_reservoir_t, reservoir);
+
+  return reservoir;
+}
+
+static VALUE reservoir_new(VALUE klass, VALUE size, VALUE weighted) {
+  sk_reservoir_t* reservoir;
+
+  CHECK_NUMERIC(size);
+
+  if (NUM2LONG(size) < 0) {
+    rb_raise(rb_eArgError, "reservoir size must not be negative");
+  }
+
+  if (!(reservoir = malloc(sizeof(sk_reservoir_t)))) {
+    rb_memerror();
+  }
+
+  sk_reservoir_init(reservoir, NUM2LONG(size), RTEST(weighted));
+
+  return Data_Wrap_Struct(rb_cReservoir, NULL, reservoir_free, reservoir);
+}
+
+/*
+ * Offers a serialized Trace to the sample. Returns true if it was kept.
+ */
+static VALUE reservoir_push(VALUE self, VALUE protobuf) {
+  int res;
+  sk_reservoir_t* reservoir = sk_reservoir_get(self);
+
+  CHECK_TYPE(protobuf, T_STRING);
+
+  if ((res = sk_reservoir_push(reservoir, RSTRING_PTR(protobuf), RSTRING_LEN(protobuf))) < 0) {
+    rb_memerror();
+  }
+
+  return res ? Qtrue : Qfalse;
+}
+
+static VALUE reservoir_count(VALUE self) {
+  return ULL2NUM(sk_reservoir_get(self)->count);
+}
+
+static VALUE reservoir_length(VALUE self) {
+  return LONG2NUM(sk_reservoir_get(self)->len);
+}
+
+static VALUE reservoir_size(VALUE self) {
+  return LONG2NUM(sk_reservoir_get(self)->size);
+}
+
+static VALUE reservoir_bytesize(VALUE self) {
+  return SIZET2NUM(sk_reservoir_get(self)->arena_live);
+}
+
+static VALUE reservoir_clear(VALUE self) {
+  sk_reservoir_clear(sk_reservoir_get(self));
+  return self;
+}
+
+/* Copies the sampled traces out; only used for inspection */
+static VALUE reservoir_traces(VALUE self) {
+  long i;
+  sk_sample_t* sample;
+  sk_reservoir_t* reservoir = sk_reservoir_get(self);
+  VALUE ret = rb_ary_new2(reservoir->len);
+
+  for (i = 0; i < reservoir->len; ++i) {
+    sample = &reservoir->samples[i];
+    rb_ary_push(ret, rb_str_new(reservoir->arena + sample->offset, sample->len));
+  }
+
+  return ret;
+}
+
+void Init_skylight_reservoir(void) {
+  rb_cReservoir = rb_define_class_under(rb_mSkylight, "Reservoir", rb_cObject);
+  rb_define_singleton_method(rb_cReservoir, "native_new", reservoir_new, 2);
+  rb_define_method(rb_cReservoir, "native_push", reservoir_push, 1);
+  rb_define_method(rb_cReservoir, "native_count", reservoir_count, 0);
+  rb_define_method(rb_cReservoir, "native_length", reservoir_length, 0);
+  rb_define_method(rb_cReservoir, "native_size", reservoir_size, 0);
+  rb_define_method(rb_cReservoir, "native_bytesize", reservoir_bytesize, 0);
+  rb_define_method(rb_cReservoir, "native_clear", reservoir_clear, 0);
+  rb_define_method(rb_cReservoir, "native_traces", reservoir_traces, 0);
+}
@@ -0,0 +1,439 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <skylight_native.h>
+
+/**
+ * Shared memory ring
+ *
+ * A single producer, single consumer ring of serialized messages living in
+ * a file that both the app process and the standalone agent map. The app
+ * process serializes traces straight into the ring and the agent reads them
+ * back out; the unix socket is only used to wake the agent up.
+ *
+ * Records are a 64 bit length followed by the payload, padded to 8 bytes. A
+ * record never wraps around the end of the ring: when it doesn't fit, a
+ * skip marker is written and the record starts back at offset 0.
+ *
+ * Wakeups follow the usual protocol. The consumer sets `waiting` before it
+ * goes to sleep and checks the ring once more; the producer publishes its
+ * record and then checks `waiting`. Full barriers between the two steps on
+ * either side guarantee that at least one of them notices the other.
+ */
+
+#define RING_MAGIC   0x534b5247 /* SKRG */
+#define RING_VERSION 1
+
+#define RING_MIN_CAPA (64 * 1024)
+#define RING_MAX_CAPA (1024 * 1024 * 1024)
+
+#define RING_SKIP UINT64_MAX
+
+#define RING_ALIGN(n) (((n) + 7) & ~((uint64_t) 7))
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t capacity;
+  char pad0[48];
+
+  /* Written by the producer only */
+  volatile uint64_t write_pos;
+  char pad1[56];
+
+  /* Written by the consumer, and cleared by the producer */
+  volatile uint64_t read_pos;
+  volatile uint32_t waiting;
+  char pad2[52];
+} ring_header_t;
+
+typedef struct {
+  ring_header_t* header;
+  uint8_t* data;
+  uint64_t mask;
+  size_t map_len;
+} ring_t;
+
+static VALUE rb_cRing;
+
+static void ring_unmap(ring_t* ring) {
+  if (ring->header) {
+    munmap(ring->header, ring->map_len);
+    ring->header = NULL;
+    ring->data = NULL;
+  }
+}
+
+static void ring_free(ring_t* ring) {
+  ring_unmap(ring);
+  free(ring);
+}
+
+static ring_t* ring_get(VALUE self) {
+  ring_t* ring;
+
+  Data_Get_Struct(self, ring_t, ring);
+
+  if (!ring->header) {
+    rb_raise(rb_eRuntimeError, "ring has been closed");
+  }
+
+  return ring;
+}
+
+static VALUE ring_wrap(ring_header_t* header, size_t map_len) {
+  ring_t* ring;
+
+  if (!(ring = malloc(sizeof(ring_t)))) {
+    munmap(header, map_len);
+    rb_memerror();
+  }
+
+  ring->header = header;
+  ring->data = (uint8_t*) (header + 1);
+  ring->mask = header->capacity - 1;
+  ring->map_len = map_len;
+
+  return Data_Wrap_Struct(rb_cRing, NULL, ring_free, ring);
+}
+
+/*
+ * Creates the file backing a new ring. The path must not exist yet.
+ */
+static VALUE ring_create(VALUE klass, VALUE path, VALUE rb_capacity) {
+  int fd;
+  uint64_t capacity = RING_MIN_CAPA;
+  size_t map_len;
+  void* map;
+  ring_header_t* header;
+
+  CHECK_TYPE(path, T_STRING);
+  CHECK_NUMERIC(rb_capacity);
+
+  while (capacity < NUM2ULL(rb_capacity) && capacity < RING_MAX_CAPA) {
+    capacity <<= 1;
+  }
+
+  map_len = sizeof(ring_header_t) + capacity;
+
+  if ((fd = open(StringValueCStr(path), O_RDWR | O_CREAT | O_EXCL, 0600)) < 0) {
+    rb_sys_fail(RSTRING_PTR(path));
+  }
+
+  if (ftruncate(fd, map_len) < 0) {
+    close(fd);
+    unlink(RSTRING_PTR(path));
+    rb_sys_fail(RSTRING_PTR(path));
+  }
+
+  map = mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (map == MAP_FAILED) {
+    unlink(RSTRING_PTR(path));
+    rb_sys_fail(RSTRING_PTR(path));
+  }
+
+  header = (ring_header_t*) map;
+  header->magic = RING_MAGIC;
+  header->version = RING_VERSION;
+  header->capacity = capacity;
+  header->write_pos = 0;
+  header->read_pos = 0;
+
+  /* The first record always wakes the consumer */
+  header->waiting = 1;
+
+  return ring_wrap(header, map_len);
+}
+
+/*
+ * Maps the ring created by another process at the given path.
+ */
+static VALUE ring_open(VALUE klass, VALUE path) {
+  int fd;
+  struct stat st;
+  void* map;
+  ring_header_t* header;
+
+  CHECK_TYPE(path, T_STRING);
+
+  if ((fd = open(StringValueCStr(path), O_RDWR)) < 0) {
+    rb_sys_fail(RSTRING_PTR(path));
+  }
+
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    rb_sys_fail(RSTRING_PTR(path));
+  }
+
+  if (st.st_size < (off_t) sizeof(ring_header_t)) {
+    close(fd);
+    rb_raise(rb_eArgError, "not a skylight ring: %s", RSTRING_PTR(path));
+  }
+
+  map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (map == MAP_FAILED) {
+    rb_sys_fail(RSTRING_PTR(path));
+  }
+
+  header = (ring_header_t*) map;
+
+  if (header->magic != RING_MAGIC || header->version != RING_VERSION ||
+      header->capacity < RING_MIN_CAPA || (header->capacity & (header->capacity - 1)) ||
+      sizeof(ring_header_t) + header->capacity != (uint64_t) st.st_size) {
+    munmap(map, st.st_size);
+    rb_raise(rb_eArgError, "not a skylight ring: %s", RSTRING_PTR(path));
+  }
+
+  return ring_wrap(header, st.st_size);
+}
+
+/*
+ * Reserves room for a record with a payload of len bytes. Returns a pointer
+ * to the payload, or NULL if the ring is too full. The record is published
+ * with ring_commit.
+ */
+static uint8_t* ring_reserve(ring_t* ring, uint64_t len, uint64_t* pos) {
+  uint64_t capacity = ring->header->capacity;
+  uint64_t need = 8 + RING_ALIGN(len);
+  uint64_t write_pos = ring->header->write_pos;
+  uint64_t used = write_pos - ring->header->read_pos;
+  uint64_t offset = write_pos & ring->mask;
+  uint64_t skip = 0;
+
+  /* Don't write over a record before the consumer is done with it */
+  __sync_synchronize();
+
+  if (need > capacity / 2) {
+    return NULL;
+  }
+
+  if (offset + need > capacity) {
+    skip = capacity - offset;
+  }
+
+  if (used + skip + need > capacity) {
+    return NULL;
+  }
+
+  if (skip) {
+    *((uint64_t*) (ring->data + offset)) = RING_SKIP;
+    write_pos += skip;
+    offset = 0;
+  }
+
+  *((uint64_t*) (ring->data + offset)) = len;
+  *pos = write_pos + need;
+
+  return ring->data + offset + 8;
+}
+
+static void ring_commit(ring_t* ring, uint64_t pos) {
+  /* The record must be visible before the new position is */
+  __sync_synchronize();
+  ring->header->write_pos = pos;
+}
+
+/*
+ * Serializes a Skylight::Trace straight into the ring. Returns false,
+ * leaving the trace untouched, if it doesn't fit; otherwise the trace is
+ * consumed as if it had been serialized.
+ */
+static VALUE ring_push_trace(VALUE self, VALUE rb_trace) {
+  size_t size;
+  uint64_t pos;
+  uint8_t* payload;
+  RustSlice slice;
+  RustSerializer serializer;
+  ring_t* ring = ring_get(self);
+
+  if (!rb_obj_is_kind_of(rb_trace, rb_cTrace)) {
+    rb_raise(rb_eArgError, "expected a Skylight::Trace but was %s", rb_obj_classname(rb_trace));
+  }
+
+  Get_Struct(trace, rb_trace, RustTrace, "You can't do anything with a Trace once it's been serialized");
+
+  CHECK_FFI(skylight_trace_get_serializer(trace, &serializer), "could not get serializer for trace");
+
+  if (!skylight_serializer_get_serialized_size(serializer, &size)) {
+    skylight_serializer_free(serializer);
+    rb_raise(rb_eRuntimeError, "could not get serialized size for trace");
+  }
+
+  if (!(payload = ring_reserve(ring, size, &pos))) {
+    skylight_serializer_free(serializer);
+    return Qfalse;
+  }
+
+  slice.data = (char*) payload;
+  slice.len = size;
+
+  if (!skylight_trace_serialize(trace, serializer, slice)) {
+    skylight_serializer_free(serializer);
+    rb_raise(rb_eRuntimeError, "could not serialize trace");
+  }
+
+  skylight_serializer_free(serializer);
+
+  ring_commit(ring, pos);
+
+  DATA_PTR(rb_trace) = NULL;
+  skylight_trace_free(trace);
+
+  return Qtrue;
+}
+
+/*
+ * Copies a serialized message into the ring. Returns false if it doesn't
+ * fit.
+ */
+static VALUE ring_push(VALUE self, VALUE protobuf) {
+  uint64_t pos;
+  uint8_t* payload;
+  ring_t* ring = ring_get(self);
+
+  CHECK_TYPE(protobuf, T_STRING);
+
+  if (!(payload = ring_reserve(ring, RSTRING_LEN(protobuf), &pos))) {
+    return Qfalse;
+  }
+
+  memcpy(payload, RSTRING_PTR(protobuf), RSTRING_LEN(protobuf));
+  ring_commit(ring, pos);
+
+  return Qtrue;
+}
+
+/*
+ * Called by the producer after pushing. Returns true if the consumer went
+ * to sleep and has to be woken up.
+ */
+static VALUE ring_wakeup_p(VALUE self) {
+  ring_t* ring = ring_get(self);
+
+  __sync_synchronize();
+
+  if (ring->header->waiting && __sync_bool_compare_and_swap(&ring->header->waiting, 1, 0)) {
+    return Qtrue;
+  }
+
+  return Qfalse;
+}
+
+/*
+ * Returns the next message in the ring, or nil if it is empty, in which
+ * case the consumer is marked as waiting for a wakeup.
+ */
+static VALUE ring_shift(VALUE self) {
+  uint64_t read_pos, write_pos, offset, len;
+  bool skipped = false;
+  VALUE ret;
+  ring_t* ring = ring_get(self);
+  ring_header_t* header = ring->header;
+
+  /*
+   * Bounds come from the size this process mapped, never from the header,
+   * which the producer can write
+   */
+  uint64_t capacity = ring->mask + 1;
+
+  read_pos = header->read_pos;
+
+  while (1) {
+    if (read_pos == (write_pos = header->write_pos)) {
+      header->waiting = 1;
+      __sync_synchronize();
+
+      if (read_pos == (write_pos = header->write_pos)) {
+        return Qnil;
+      }
+
+      header->waiting = 0;
+    }
+
+    /*
+     * The producer is never more than the ring ahead, and never behind.
+     * Checked before following any record, so a corrupt position can't
+     * send the loop below around the ring over and over.
+     */
+    if (write_pos - read_pos > capacity) {
+      rb_raise(rb_eRuntimeError, "corrupt skylight ring");
+    }
+
+    /* Don't read the record before seeing the position that published it */
+    __sync_synchronize();
+
+    offset = read_pos & ring->mask;
+
+    if (offset + 8 > capacity) {
+      rb_raise(rb_eRuntimeError, "corrupt skylight ring");
+    }
+
+    len = *((uint64_t*) (ring->data + offset));
+
+    /* A skip pads out the end of the ring, so a record always follows it */
+    if (len == RING_SKIP) {
+      if (skipped) {
+        rb_raise(rb_eRuntimeError, "corrupt skylight ring");
+      }
+
+      skipped = true;
+      read_pos += capacity - offset;
+      continue;
+    }
+
+    /* A torn or corrupt record must not send the read past the mapping */
+    if (len > capacity / 2 || len > capacity - offset - 8) {
+      rb_raise(rb_eRuntimeError, "corrupt skylight ring");
+    }
+
+    break;
+  }
+
+  ret = rb_str_new((const char*) ring->data + offset + 8, len);
+
+  /* Done with the record before handing its space back */
+  __sync_synchronize();
+  header->read_pos = read_pos + 8 + RING_ALIGN(len);
+
+  return ret;
+}
+
+/* Bytes currently held by the ring */
+static VALUE ring_used(VALUE self) {
+  ring_t* ring = ring_get(self);
+  return ULL2NUM(ring->header->write_pos - ring->header->read_pos);
+}
+
+static VALUE ring_capacity(VALUE self) {
+  return ULL2NUM(ring_get(self)->header->capacity);
+}
+
+static VALUE ring_close(VALUE self) {
+  ring_t* ring;
+
+  Data_Get_Struct(self, ring_t, ring);
+  ring_unmap(ring);
+
+  return Qnil;
+}
+
+void Init_skylight_ring(void) {
+  rb_cRing = rb_define_class_under(rb_mSkylight, "Ring", rb_cObject);
+  rb_define_singleton_method(rb_cRing, "native_create", ring_create, 2);
+  rb_define_singleton_method(rb_cRing, "native_open", ring_open, 1);
+  rb_define_method(rb_cRing, "native_push_trace", ring_push_trace, 1);
+  rb_define_method(rb_cRing, "native_push", ring_push, 1);
+  rb_define_method(rb_cRing, "native_wakeup?", ring_wakeup_p, 0);
+  rb_define_method(rb_cRing, "native_shift", ring_shift, 0);
+  rb_define_method(rb_cRing, "native_used", ring_used, 0);
+  rb_define_method(rb_cRing, "native_capacity", ring_capacity, 0);
+  rb_define_method(rb_cRing, "native_close", ring_close, 0);
+}
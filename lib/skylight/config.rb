@@ -30,13 +30,22 @@ module Skylight
       'AGENT_INTERVAL'          => :'agent.interval',
       'AGENT_KEEPALIVE'         => :'agent.keepalive',
       'AGENT_SAMPLE_SIZE'       => :'agent.sample',
+      'AGENT_SAMPLE_STRATEGY'   => :'agent.sample_strategy',
       'AGENT_SOCKFILE_PATH'     => :'agent.sockfile_path',
       'AGENT_STRATEGY'          => :'agent.strategy',
       'AGENT_MAX_MEMORY'        => :'agent.max_memory',
+      'AGENT_IPC'               => :'agent.ipc',
+      'AGENT_IPC_RING_SIZE'     => :'agent.ipc_ring_size',
+      'AGENT_SPOOL_PATH'        => :'agent.spool_path',
+      'AGENT_SPOOL_MAX_SIZE'    => :'agent.spool_max_size',
+      'AGENT_DESCRIPTION_WINDOW' => :'agent.description_window',
+      'AGENT_DESCRIPTION_ENDPOINTS' => :'agent.description_endpoints',
+      'AGENT_INGEST_SHARDS'     => :'agent.ingest_shards',
       'REPORT_HOST'             => :'report.host',
       'REPORT_PORT'             => :'report.port',
       'REPORT_SSL'              => :'report.ssl',
       'REPORT_DEFLATE'          => :'report.deflate',
+      'REPORT_DEFLATE_LEVEL'    => :'report.deflate_level',
       'REPORT_PROXY_ADDR'       => :'report.proxy_addr',
       'REPORT_PROXY_PORT'       => :'report.proxy_port',
       'REPORT_PROXY_USER'       => :'report.proxy_user',
@@ -52,6 +61,8 @@ module Skylight
       'ME_AUTHENTICATION'       => :'me.authentication',
       'ME_CREDENTIALS_PATH'     => :'me.credentials_path',
       'METRICS_REPORT_INTERVAL' => :'metrics.report_interval',
+      'SQL_CACHE_SIZE'          => :'normalizers.sql.cache_size',
+      'DEFER_NORMALIZATION'     => :'normalizers.defer',
       'TEST_CONSTANT_FLUSH'     => :'test.constant_flush',
       'TEST_IGNORE_TOKEN'       => :'test.ignore_token' }
 
@@ -63,17 +74,27 @@ module Skylight
       :'agent.keepalive'         => 60,
       :'agent.interval'          => 5,
       :'agent.sample'            => 200,
+      :'agent.sample_strategy'   => 'uniform'.freeze,
       :'agent.max_memory'        => 256, # MB
+      :'agent.ipc'               => 'socket'.freeze,
+      :'agent.ipc_ring_size'     => 4 * 1024 * 1024, # bytes
+      :'agent.spool_max_size'    => 32 * 1024 * 1024, # bytes
+      :'agent.description_window' => 0, # seconds, 0 never resets
+      :'agent.description_endpoints' => 1024, # endpoints limited separately, the rest share one limit
+      :'agent.ingest_shards'     => 0, # threads, 0 ingests on the collector thread
       :'report.host'             => 'agent.skylight.io'.freeze,
       :'report.port'             => 443,
       :'report.ssl'              => true,
       :'report.deflate'          => true,
+      :'report.deflate_level'    => 6,
       :'accounts.host'           => 'www.skylight.io'.freeze,
       :'accounts.port'           => 443,
       :'accounts.ssl'            => true,
       :'accounts.deflate'        => false,
       :'me.credentials_path'     => '~/.skylight',
-      :'metrics.report_interval' => 60
+      :'metrics.report_interval' => 60,
+      :'normalizers.sql.cache_size' => 1000,
+      :'normalizers.defer'       => false
     }.freeze
 
     REQUIRED = {
@@ -83,7 +104,14 @@ module Skylight
       :'report.port'    => "skylight remote port" }
 
     VALIDATORS = {
-      :'agent.interval' => [lambda { |v, c| Integer === v && v > 0 }, "must be an integer greater than 0"]
+      :'agent.interval' => [lambda { |v, c| Integer === v && v > 0 }, "must be an integer greater than 0"],
+      :'agent.sample_strategy' => [lambda { |v, c| %w(uniform weighted).include?(v.to_s) }, "must be uniform or weighted"],
+      :'agent.ipc' => [lambda { |v, c| %w(socket ring).include?(v.to_s) }, "must be socket or ring"],
+      :'report.deflate_level' => [lambda { |v, c| Integer === v && v >= 0 && v <= 9 }, "must be an integer between 0 and 9"],
+      :'agent.description_window' => [lambda { |v, c| Integer === v && v >= 0 }, "must be an integer greater than or equal to 0"],
+      :'agent.description_endpoints' => [lambda { |v, c| Integer === v && v > 0 && v <= 65536 }, "must be an integer between 1 and 65536"],
+      :'agent.ingest_shards' => [lambda { |v, c| Integer === v && v >= 0 && v <= 256 }, "must be an integer between 0 and 256"],
+      :'normalizers.sql.cache_size' => [lambda { |v, c| Integer === v && v >= 0 }, "must be an integer greater than or equal to 0"]
     }
 
     def self.load(path = nil, environment = nil, env = ENV)
@@ -2,11 +2,13 @@ require 'thread'
 
 module Skylight
   # @api private
+  #
+  # GC times, from the profiler's total_time on, are in nanoseconds
   class GC
     METHODS   = [ :enable, :total_time ]
     TH_KEY    = :SK_GC_CURR_WINDOW
     MAX_COUNT = 1000
-    MAX_TIME  = 30_000_000
+    MAX_TIME  = 30_000_000_000
 
     include Util::Logging
 
@@ -21,6 +23,10 @@ module Skylight
       if METHODS.all? { |m| profiler.respond_to?(m) }
         @profiler = profiler
         @time = @profiler.total_time
+
+        # Profilers whose total time only grows can be read by every trace
+        # on its own, without the lock and the listener list
+        @monotonic = profiler.respond_to?(:monotonic?) && profiler.monotonic?
       else
         debug "disabling GC profiling"
       end
@@ -31,8 +37,10 @@ module Skylight
     end
 
     def track
-      unless @profiler
+      if !@profiler
         win = Window.new(nil)
+      elsif @monotonic
+        win = Snapshot.new(@profiler)
       else
         win = Window.new(self)
 
@@ -103,5 +111,24 @@ module Skylight
       end
     end
 
+    # A Window over a monotonic profiler, measuring the GC time since it was
+    # created
+    class Snapshot
+      def initialize(profiler)
+        @profiler = profiler
+        @start    = profiler.total_time
+      end
+
+      def update
+      end
+
+      def time
+        @profiler.total_time - @start
+      end
+
+      def release
+      end
+    end
+
   end
 end
@@ -10,6 +10,9 @@ module Skylight
 
     TOO_MANY_UNIQUES = "<too many unique descriptions>"
 
+    # Distinct descriptions allowed per endpoint
+    MAX_DESCRIPTIONS = 100
+
     include Util::Logging
 
     class TraceInfo
@@ -62,6 +65,12 @@ module Skylight
 
       @trace_info = @config[:trace_info] || TraceInfo.new
       @descriptions = Hash.new { |h,k| h[k] = {} }
+
+      if Skylight.native?
+        @limiter = DescriptionLimiter.native_new(MAX_DESCRIPTIONS,
+                                                 config[:'agent.description_window'].to_i,
+                                                 config[:'agent.description_endpoints'].to_i)
+      end
     end
 
     def current_trace
@@ -201,14 +210,19 @@ module Skylight
       end
     end
 
-    def limited_description(description)
-      endpoint = nil
-      endpoint = @trace_info.current.endpoint
+    # Deferred normalization runs off the request thread, so it passes the
+    # endpoint in rather than relying on the current trace
+    def limited_description(description, endpoint = @trace_info.current.endpoint)
+      # Lock free, see skylight_limiter.c
+      if @limiter
+        return description if @limiter.native_add(endpoint && endpoint.to_s, description && description.to_s)
+        return TOO_MANY_UNIQUES
+      end
 
       DESC_LOCK.synchronize do
         set = @descriptions[endpoint]
 
-        if set.size >= 100
+        if set.size >= MAX_DESCRIPTIONS
           return TOO_MANY_UNIQUES
         end
 
@@ -5,17 +5,22 @@ module Skylight
     require 'skylight/messages/hello'
     require 'skylight/messages/error'
     require 'skylight/messages/trace_envelope'
+    require 'skylight/messages/ring'
 
     KLASS_TO_ID = {
       Skylight::Trace => 0,
       Skylight::Hello => 1,
-      Skylight::Error => 2
+      Skylight::Error => 2,
+      Skylight::Messages::RingAttach => 3,
+      Skylight::Messages::RingWakeup => 4
     }
 
     ID_TO_KLASS = {
       0 => Skylight::Messages::TraceEnvelope,
       1 => Skylight::Hello,
-      2 => Skylight::Error
+      2 => Skylight::Error,
+      3 => Skylight::Messages::RingAttach,
+      4 => Skylight::Messages::RingWakeup
     }
   end
 end
@@ -0,0 +1,36 @@
+module Skylight
+  module Messages
+    # Sent by a client after the Hello when it has set up a shared memory
+    # ring. The agent maps the ring file, named `name` in the sockfile
+    # directory, and reads traces out of it.
+    class RingAttach
+      def self.deserialize(data)
+        new(data)
+      end
+
+      attr_reader :name
+
+      def initialize(name)
+        @name = name
+      end
+
+      def serialize
+        @name
+      end
+    end
+
+    # Sent by a client when it has pushed into its ring while the agent was
+    # waiting for more data.
+    class RingWakeup
+      def self.deserialize(data)
+        INSTANCE
+      end
+
+      def serialize
+        ''.freeze
+      end
+
+      INSTANCE = new
+    end
+  end
+end
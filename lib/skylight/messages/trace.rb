@@ -4,11 +4,22 @@ module Skylight
       class Builder
         GC_CAT = 'noise.gc'.freeze
 
+        # Number of recorded spans to buffer before handing them to the native
+        # trace in a single call
+        MAX_PENDING_SPANS = 128
+
+        UUID = 'TODO'.freeze
+
         include Util::Logging
 
         attr_reader   :endpoint, :spans, :notifications
 
+        # Notifications left for the worker to normalize, see
+        # Normalizers::Deferred
+        attr_accessor :deferred
+
         def endpoint=(value)
+          raise "Can only set the endpoint before submitting" if @submitted
           @endpoint = value.is_a?(String) ? value.freeze : value
           @native_builder.native_set_name(value)
         end
@@ -18,7 +29,7 @@ module Skylight
 
           start = normalize_time(start)
 
-          @native_builder = ::Skylight::Trace.native_new(start, "TODO")
+          @native_builder = ::Skylight::Trace.acquire(start, UUID)
           @native_builder.native_set_name(endpoint)
 
           @instrumenter  = instrumenter
@@ -26,7 +37,16 @@ module Skylight
           @submitted     = false
           @start         = start
 
+          # With the default clock, span times are read by the native trace
+          # in the same call that starts or stops the span
+          @native_clock  = Util::Clock.native?
+
           @notifications = []
+          @deferred      = nil
+
+          # Flat list of [start, stop, cat, title, desc] groups waiting to be
+          # written to the native trace. See #flush_spans.
+          @pending       = []
 
           if Hash === title
             annot = title
@@ -37,16 +57,19 @@ module Skylight
           end
 
           # create the root node
-          @root = @native_builder.native_start_span(@start, cat)
-          @native_builder.native_span_set_title(@root, title) if title
-          @native_builder.native_span_set_description(@root, desc) if desc
+          @root = span(@start, cat, title, desc)
 
           @gc   = config.gc.track unless ENV.key?("SKYLIGHT_DISABLE_GC_TRACKING")
         end
 
         def serialize
           raise "Can only serialize once" if @serialized
+          # The native trace went to the instrumenter with the submit
+          raise "Can only serialize before submitting" if @submitted
           @serialized = true
+          flush_spans
+          hand_off_deferred
+          @native_builder.apply_deferred
           @native_builder.native_serialize
         end
 
@@ -68,9 +91,12 @@ module Skylight
 
           desc = @instrumenter.limited_description(desc)
 
-          time = Util::Clock.nanos - gc_time
+          time = now
 
-          stop(start(time, cat, title, desc), time)
+          # Recorded spans are closed immediately, so they can be buffered and
+          # written together with the next native call.
+          @pending.push(time, time, intern(cat), title && title.to_s, desc && desc.to_s)
+          flush_spans if @pending.length >= MAX_PENDING_SPANS * 5
 
           nil
         end
@@ -90,7 +116,7 @@ module Skylight
           desc.freeze  if desc.is_a?(String)
 
           original_desc = desc
-          now           = Util::Clock.nanos
+          started_at    = Util::Clock.nanos unless @native_clock
           desc          = @instrumenter.limited_description(desc)
 
           if desc == Instrumenter::TOO_MANY_UNIQUES
@@ -99,12 +125,25 @@ module Skylight
             debug "cat=%s, title=%s, desc=%s, annot=%s", cat, title, desc, annot.inspect
           end
 
-          start(now - gc_time, cat, title, desc, annot)
+          if @native_clock
+            flush_spans
+            @native_builder.native_start_span_now(gc_time, intern(cat), title && title.to_s, desc && desc.to_s)
+          else
+            start(started_at - gc_time, cat, title, desc, annot)
+          end
         end
 
         def done(span)
-          return unless span
-          stop(span, Util::Clock.nanos - gc_time)
+          # Spans closed after submitting would land in a recycled trace
+          return if !span || @submitted
+
+          if @native_clock
+            flush_spans
+            @native_builder.native_stop_span_now(span, gc_time)
+            nil
+          else
+            stop(span, normalize_time(Util::Clock.nanos - gc_time))
+          end
         end
 
         def release
@@ -114,11 +153,19 @@ module Skylight
 
         def traced
           time = gc_time
-          now = Util::Clock.nanos
+
+          if @native_clock
+            now = @native_builder.native_now(0)
+            gc_started_at = now - normalize_time(time)
+          else
+            nanos = Util::Clock.nanos
+            now = normalize_time(nanos)
+            gc_started_at = normalize_time(nanos - time)
+          end
 
           if time > 0
             t { fmt "tracking GC time; duration=%d", time }
-            stop(start(now - time, GC_CAT, nil, nil, {}), now)
+            stop(span(gc_started_at, GC_CAT, nil, nil, {}), now)
           end
 
           stop(@root, now)
@@ -136,8 +183,12 @@ module Skylight
           @submitted = true
 
           traced
+          hand_off_deferred
 
-          @instrumenter.process(@native_builder)
+          # The native trace may be recycled for another request once it is
+          # written out, so it is not kept
+          native, @native_builder = @native_builder, nil
+          @instrumenter.process(native)
         rescue Exception => e
           error e
           t { e.backtrace.join("\n") }
@@ -149,11 +200,22 @@ module Skylight
           span(normalize_time(time), cat, title, desc, annot)
         end
 
+        # Takes the stop time in ticks, see #normalize_time
         def stop(span, time)
-          @native_builder.native_stop_span(span, normalize_time(time))
+          flush_spans
+          @native_builder.native_stop_span(span, time)
           nil
         end
 
+        # Current time in ticks, less the GC time during the trace
+        def now
+          if @native_clock
+            @native_builder.native_now(gc_time)
+          else
+            normalize_time(Util::Clock.nanos - gc_time)
+          end
+        end
+
         def normalize_time(time)
           # At least one customer has extensions that cause integer division to produce rationals.
           # Since the native code expects an integer, we force it again.
@@ -161,10 +223,31 @@ module Skylight
         end
 
         def span(time, cat, title=nil, desc=nil, annot=nil)
-          sp = @native_builder.native_start_span(time, cat.to_s)
-          @native_builder.native_span_set_title(sp, title.to_s) if title
-          @native_builder.native_span_set_description(sp, desc.to_s) if desc
-          sp
+          @pending.push(time, nil, intern(cat), title && title.to_s, desc && desc.to_s)
+          flush_spans
+        end
+
+        # Categories repeat across spans and traces, so they are passed to the
+        # native trace as interned ids. Titles are passed as strings, as there
+        # is no bound on how many distinct ones an app produces.
+        def intern(str)
+          ::Skylight::Trace.intern(str.to_s)
+        end
+
+        # Writes any buffered span records to the native trace in one call and
+        # returns the index of the last span started.
+        def flush_spans
+          return if @pending.empty?
+          @native_builder.native_record_spans(@pending)
+        ensure
+          @pending.clear
+        end
+
+        def hand_off_deferred
+          return unless @deferred
+          @deferred.endpoint = @endpoint
+          @native_builder.deferred = @deferred
+          @deferred = nil
         end
 
         def gc_time
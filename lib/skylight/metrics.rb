@@ -1,9 +1,20 @@
 module Skylight
   # @api private
   module Metrics
-    autoload :Meter,           'skylight/metrics/meter'
-    autoload :EWMA,            'skylight/metrics/ewma'
-    autoload :ProcessMemGauge, 'skylight/metrics/process_mem_gauge'
-    autoload :ProcessCpuGauge, 'skylight/metrics/process_cpu_gauge'
+    autoload :Meter,              'skylight/metrics/meter'
+    autoload :EWMA,               'skylight/metrics/ewma'
+    autoload :ProcessMemGauge,    'skylight/metrics/process_mem_gauge'
+    autoload :ProcessCpuGauge,    'skylight/metrics/process_cpu_gauge'
+    autoload :ProcessHealthGauge, 'skylight/metrics/process_health_gauge'
+    autoload :SharedSampler,      'skylight/metrics/shared_sampler'
+
+    # Reads the process's /proc entries without forking or allocating, or
+    # nil where they can't be read natively. The gauges given it share one
+    # sample per report, see SharedSampler.
+    def self.proc_sampler
+      return unless Skylight.native?
+      sampler = ProcSampler.native_new
+      SharedSampler.new(sampler) if sampler.sample
+    end
   end
-end
\ No newline at end of file
+end
@@ -2,8 +2,9 @@ module Skylight
   module Metrics
     class ProcessCpuGauge
 
-      def initialize(cache_for = 5, clock = Util::Clock.default)
+      def initialize(cache_for = 5, clock = Util::Clock.default, sampler = nil)
         @value = nil
+        @sampler = sampler
         @cache_for = cache_for
         @last_check_at = 0
         @clock = clock
@@ -28,17 +29,14 @@ module Skylight
       def check
         ret = nil
 
-        statfile = "/proc/stat"
-        pidstatfile = "/proc/#{Process.pid}/stat"
-
-        if File.exist?(statfile) && File.exist?(pidstatfile)
-          cpustats = File.readlines(statfile).grep(/^cpu /).first.split(' ')
-          usagetime = cpustats[1..3].reduce(0){|sum, i| sum + i.to_i }
-          totaltime = usagetime + cpustats[4].to_i
-
-          pidstats = File.read(pidstatfile).split(' ')
-          utime, stime = pidstats[13].to_i, pidstats[14].to_i
+        if @sampler && @sampler.sample
+          usagetime, totaltime = @sampler.cpu_usage, @sampler.cpu_total
+          utime, stime = @sampler.utime, @sampler.stime
+        elsif stats = read_proc_files
+          usagetime, totaltime, utime, stime = stats
+        end
 
+        if usagetime
           if @last_totaltime && @last_usagetime && @last_utime && @last_stime
             elapsed = totaltime - @last_totaltime
             ret = [(usagetime - @last_usagetime).to_f / elapsed,
@@ -57,6 +55,24 @@ module Skylight
         nil
       end
 
+      # Returns [usagetime, totaltime, utime, stime], or nil if they can't be
+      # read
+      def read_proc_files
+        statfile = "/proc/stat"
+        pidstatfile = "/proc/#{Process.pid}/stat"
+
+        return unless File.exist?(statfile) && File.exist?(pidstatfile)
+
+        cpustats = File.readlines(statfile).grep(/^cpu /).first.split(' ')
+        usagetime = cpustats[1..3].reduce(0){|sum, i| sum + i.to_i }
+        totaltime = usagetime + cpustats[4].to_i
+
+        pidstats = File.read(pidstatfile).split(' ')
+        utime, stime = pidstats[13].to_i, pidstats[14].to_i
+
+        [usagetime, totaltime, utime, stime]
+      end
+
       def should_check?(now)
         now >= @last_check_at + @cache_for
       end
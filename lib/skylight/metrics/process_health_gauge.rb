@@ -0,0 +1,36 @@
+module Skylight
+  module Metrics
+    # Reports one of the counters read by a SharedSampler, such as the page
+    # faults or open file descriptors of the process
+    class ProcessHealthGauge
+
+      def initialize(sampler, field, cache_for = 30, clock = Util::Clock.default)
+        @sampler = sampler
+        @field = field
+        @value = nil
+        @cache_for = cache_for
+        @last_check_at = 0
+        @clock = clock
+      end
+
+      def call(now = @clock.absolute_secs)
+        if !@value || should_check?(now)
+          @value = check
+          @last_check_at = now
+        end
+
+        @value
+      end
+
+    private
+
+      def check
+        @sampler.public_send(@field) if @sampler.sample
+      end
+
+      def should_check?(now)
+        now >= @last_check_at + @cache_for
+      end
+    end
+  end
+end
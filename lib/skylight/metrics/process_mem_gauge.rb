@@ -2,8 +2,9 @@ module Skylight
   module Metrics
     class ProcessMemGauge
 
-      def initialize(cache_for = 30, clock = Util::Clock.default)
+      def initialize(cache_for = 30, clock = Util::Clock.default, sampler = nil)
         @value = nil
+        @sampler = sampler
         @cache_for = cache_for
         @last_check_at = 0
         @clock = clock
@@ -21,6 +22,10 @@ module Skylight
     private
 
       def check
+        if @sampler && @sampler.sample
+          return @sampler.rss / (1024 * 1024)
+        end
+
         `ps -o rss= -p #{Process.pid}`.to_i / 1024
       rescue Errno::ENOENT, Errno::EINTR
         0
@@ -0,0 +1,45 @@
+module Skylight
+  module Metrics
+    # Shares a ProcSampler between the worker's gauges. The reporter reads
+    # every gauge at once, so rather than each of them reading /proc, the
+    # first one to ask takes a sample and the rest read their fields from it.
+    class SharedSampler
+      FIELDS = [
+        :rss,
+        :minor_faults,
+        :major_faults,
+        :utime,
+        :stime,
+        :threads,
+        :cpu_usage,
+        :cpu_total,
+        :voluntary_switches,
+        :involuntary_switches,
+        :open_fds
+      ].freeze
+
+      def initialize(sampler, cache_for = 1, clock = Util::Clock.default)
+        @sampler = sampler
+        @cache_for = cache_for
+        @clock = clock
+        @sampled = false
+        @sampled_at = nil
+      end
+
+      # Returns whether the fields hold a sample, only sampling again once
+      # the last one is cache_for seconds old
+      def sample(now = @clock.absolute_secs)
+        if !@sampled_at || now >= @sampled_at + @cache_for
+          @sampled = @sampler.sample
+          @sampled_at = now
+        end
+
+        @sampled
+      end
+
+      FIELDS.each do |field|
+        define_method(field) { @sampler.public_send(field) }
+      end
+    end
+  end
+end
@@ -74,12 +74,107 @@ module Skylight
     # @api private
     class Trace
       alias serialize native_serialize
+
+      # Normalization left to run off the request thread, see
+      # Normalizers::Deferred
+      attr_accessor :deferred
+
+      # Fills in the spans whose normalization was deferred. Workers call
+      # this before serializing the trace.
+      def apply_deferred
+        return unless deferred = @deferred
+        @deferred = nil
+        deferred.apply(self)
+      end
+
+      # Serialized traces whose Ruby objects are kept for new requests. The
+      # pool is filled by the writer thread and drained by request threads,
+      # so it is shared, relying on the GVL for Array#push and #pop.
+      POOL      = []
+      POOL_SIZE = 64
+
+      # Returns a trace for a new request, reusing a pooled one if there is
+      # one
+      def self.acquire(started_at, uuid)
+        if trace = POOL.pop
+          trace.native_reset(started_at, uuid)
+        else
+          native_new(started_at, uuid)
+        end
+      end
+
+      # Returns the trace to the pool once it has been serialized. Nothing
+      # else may use it afterwards.
+      def recycle
+        @deferred = nil
+        POOL.push(self) if POOL.length < POOL_SIZE
+        nil
+      end
+
+      INTERNED = {}
+
+      # Returns the interned id for the string, which can be passed to the
+      # native span methods in place of the string itself. Once the native
+      # table is full, the string is returned unchanged without asking it.
+      def self.intern(str)
+        if id = INTERNED[str]
+          return id
+        end
+
+        return str if @interned_full
+
+        if id = native_intern(str)
+          INTERNED[str] = id
+        else
+          @interned_full = true
+        end
+
+        id || str
+      end
     end
 
     # @api private
     class Batch
       alias serialize native_serialize
     end
+
+    # @api private
+    # Same interface as Util::Queue
+    class MpscQueue
+      alias push       native_push
+      alias pop        native_pop
+      alias drain      native_drain
+      alias length     native_length
+      alias empty?     native_empty?
+      alias drops      native_drops
+      alias high_water native_high_water
+    end
+
+    # @api private
+    class LruCache
+      alias []     native_get
+      alias []=    native_set
+      alias length native_length
+      alias clear  native_clear
+      alias hits   native_hits
+      alias misses native_misses
+    end
+
+    # @api private
+    class ProcSampler
+      alias sample               native_sample
+      alias rss                  native_rss
+      alias minor_faults         native_minor_faults
+      alias major_faults         native_major_faults
+      alias utime                native_utime
+      alias stime                native_stime
+      alias threads              native_threads
+      alias cpu_usage            native_cpu_usage
+      alias cpu_total            native_cpu_total
+      alias voluntary_switches   native_voluntary_switches
+      alias involuntary_switches native_involuntary_switches
+      alias open_fds             native_open_fds
+    end
   end
 
   # @api private
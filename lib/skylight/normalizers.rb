@@ -27,6 +27,11 @@ module Skylight
       Container.new(normalizers)
     end
 
+    # Normalizers that can run off the request thread also define
+    # `capture(trace, name, payload)`. It returns :skip, or the category and
+    # a copy of just the payload fields that `normalize` reads, which is
+    # then normalized by the worker. Fields the instrumented code may go on
+    # to change must be copied too, not just referenced. See Deferred.
     class Normalizer
       def self.register(name)
         Normalizers.register(name, self)
@@ -47,6 +52,10 @@ module Skylight
         @paths = config['normalizers.render.view_paths'] || []
       end
 
+      def capture(trace, name, payload)
+        [ self.class::CAT, { identifier: payload[:identifier], count: payload[:count] } ]
+      end
+
       def normalize_render(category, payload, annotations)
         if path = payload[:identifier]
           title = relative_path(path, annotations)
@@ -118,6 +127,71 @@ module Skylight
         normalizer = @normalizers[name] || DEFAULT
         normalizer.normalize(trace, name, payload)
       end
+
+      # Returns :skip or the category and captured payload of a notification
+      # that can be normalized later, or nil if it has to be normalized now
+      def capture(trace, name, payload)
+        normalizer = @normalizers[name]
+        normalizer.capture(trace, name, payload) if normalizer.respond_to?(:capture)
+      end
+    end
+
+    # Notifications captured on the request thread, whose spans get their
+    # title and description once the worker normalizes them, right before
+    # the trace is serialized
+    class Deferred
+      include Util::Logging
+
+      attr_reader :config
+
+      # The endpoint the trace ended up with, for limiting descriptions
+      attr_accessor :endpoint
+
+      def initialize(container, instrumenter)
+        @container    = container
+        @instrumenter = instrumenter
+        @config       = instrumenter.config
+        @endpoint     = nil
+
+        # Flat list of [span, name, payload] groups
+        @spans        = []
+      end
+
+      def push(span, name, payload)
+        @spans.push(span, name, payload)
+      end
+
+      def apply(trace)
+        i = 0
+
+        while i < @spans.length
+          apply_span(trace, @spans[i], @spans[i + 1], @spans[i + 2])
+          i += 3
+        end
+
+        @spans.clear
+      end
+
+    private
+
+      def apply_span(trace, span, name, payload)
+        cat, title, desc, annot = @container.normalize(nil, name, payload)
+        return if cat == :skip
+
+        if error = annot && annot.delete(:skylight_error)
+          @instrumenter.error(*error)
+        end
+
+        trace.native_span_set_title(span, title.to_s) if title
+
+        if desc
+          desc = @instrumenter.limited_description(desc.to_s, @endpoint)
+          trace.native_span_set_description(span, desc)
+        end
+      rescue Exception => e
+        error "deferred normalization error; name=%s; msg=%s", name, e.message
+        t { e.backtrace.join("\n") }
+      end
     end
 
     %w( moped
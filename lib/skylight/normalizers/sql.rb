@@ -8,6 +8,22 @@ module Skylight
 
       CAT = "db.sql.query".freeze
 
+      UNKNOWN = SqlLexer::Lexer::UNKNOWN
+
+      # Queries longer than this are lexed every time rather than cached
+      MAX_CACHED_SQL = 16 * 1024
+
+      # Passed to the lexer in place of the binds, so that placeholders come
+      # back as their index into the binds rather than as a value. The lexed
+      # query then holds for every run of the query, whatever its binds.
+      BIND_INDEXES = Object.new
+      def BIND_INDEXES.[](i); i; end
+
+      def setup
+        size = config[:'normalizers.sql.cache_size'].to_i
+        @cache = LruCache.native_new(size) if size > 0 && Skylight.native?
+      end
+
       def normalize(trace, name, payload)
         case payload[:name]
         when "SCHEMA", "CACHE"
@@ -17,46 +33,120 @@ module Skylight
           title = payload[:name] || "SQL"
         end
 
-        binds = payload[:binds]
-
-        if binds && !binds.empty?
-          binds = binds.map { |col, val| val.inspect }
-        end
-
-        extracted_title, sql, binds, error = extract_binds(payload, binds)
+        extracted_title, sql, binds, error = lex(payload)
         title = extracted_title if extracted_title
 
         if sql
           annotations = {
             sql:   sql,
-            binds: binds,
+            binds: bind_values(binds, payload[:binds]),
           }
         else
           annotations = {
-            skylight_error: error
+            skylight_error: parse_error(error, payload)
           }
         end
 
         [ name, title, sql, annotations ]
       end
 
+      # Skips the same queries as #normalize, keeping only what it reads.
+      # ActiveRecord may reuse the sql and binds once the notification is
+      # done, so the worker gets copies of them rather than the originals.
+      def capture(trace, name, payload)
+        case payload[:name]
+        when "SCHEMA", "CACHE"
+          :skip
+        else
+          [ CAT, { name:  payload[:name],
+                   sql:   snapshot(payload[:sql]),
+                   binds: capture_binds(payload[:binds]) } ]
+        end
+      end
+
     private
-      def extract_binds(payload, precalculated)
-        title, sql, binds = SqlLexer::Lexer.bindify(payload[:sql], precalculated)
-        [ title, sql, binds, nil ]
+      # Returns the frozen [title, sql, binds, error] of a query, from the
+      # cache when it was seen before. Queries that can't be lexed are
+      # cached too, along with what the error they first produced said, but
+      # not the payload it was produced for.
+      def lex(payload)
+        sql = payload[:sql]
+        cache = @cache && String === sql && sql.bytesize <= MAX_CACHED_SQL
+
+        if cache && lexed = @cache[sql]
+          return lexed
+        end
+
+        lexed = extract_binds(payload)
+        @cache[sql] = lexed if cache
+        lexed
+      end
+
+      def extract_binds(payload)
+        title, sql, binds = SqlLexer::Lexer.bindify(payload[:sql], BIND_INDEXES)
+        binds.each(&:freeze)
+        [ title.freeze, sql.freeze, binds.freeze, nil ].freeze
       rescue => e
-        group = "sql_parse"
-        description = e.inspect
-        details = encode(backtrace: e.backtrace,
+        error = [ e.inspect, e.class.name, e.message, e.backtrace ].freeze
+        [ nil, nil, nil, error ].freeze
+      end
+
+      # The error reported for a query that couldn't be lexed, with the
+      # details of this run of it
+      def parse_error(error, payload)
+        description, class_name, message, backtrace = error
+
+        details = encode(backtrace: backtrace,
                           original_exception: {
-                            class_name: e.class.name,
-                            message: e.message
+                            class_name: class_name,
+                            message: message
                           },
                           payload: payload,
-                          precalculated: precalculated)
+                          precalculated: inspect_binds(payload[:binds]))
+
+        [ "sql_parse", description, details ]
+      end
+
+      # Fills the lexed binds in, only inspecting the binds that one of the
+      # query's placeholders refers to
+      def bind_values(lexed, binds)
+        lexed.map do |bind|
+          if Integer === bind
+            (bind = binds && binds[bind]) ? inspect_bind(bind) : UNKNOWN
+          else
+            bind
+          end
+        end
+      end
+
+      # Only the value of each [column, value] bind is inspected, so the
+      # column is left behind
+      def capture_binds(binds)
+        binds && binds.map { |_, val| [ nil, snapshot(val) ].freeze }.freeze
+      end
+
+      def snapshot(val)
+        case val
+        when String
+          val.frozen? ? val : val.dup.freeze
+        when Array
+          val.map { |v| snapshot(v) }.freeze
+        when Hash
+          hash = {}
+          val.each { |k, v| hash[k] = snapshot(v) }
+          hash.freeze
+        else
+          val
+        end
+      end
+
+      def inspect_binds(binds)
+        binds && !binds.empty? ? binds.map { |bind| inspect_bind(bind) } : binds
+      end
 
-        error = [group, description, details]
-        [ nil, nil, nil, error ]
+      def inspect_bind(bind)
+        _, val = bind
+        val.inspect
       end
 
       # While operating in place would save memory, some of these passed in items are re-used elsewhere
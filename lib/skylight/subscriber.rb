@@ -10,6 +10,7 @@ module Skylight
       @subscriber   = nil
       @normalizers  = Normalizers.build(config)
       @instrumenter = instrumenter
+      @defer        = !!config[:'normalizers.defer']
     end
 
     def register!
@@ -40,14 +41,18 @@ module Skylight
       return if @instrumenter.disabled?
       return unless trace = @instrumenter.current_trace
 
-      cat, title, desc, annot = normalize(trace, name, payload)
+      if @defer && captured = @normalizers.capture(trace, name, payload)
+        span = defer(trace, name, *captured) unless captured == :skip
+      else
+        cat, title, desc, annot = normalize(trace, name, payload)
 
-      if cat != :skip && error = annot.delete(:skylight_error)
-        @instrumenter.error(*error)
-      end
+        if cat != :skip && error = annot.delete(:skylight_error)
+          @instrumenter.error(*error)
+        end
 
-      unless cat == :skip
-        span = trace.instrument(cat, title, desc, annot)
+        unless cat == :skip
+          span = trace.instrument(cat, title, desc, annot)
+        end
       end
 
       trace.notifications << Notification.new(name, span)
@@ -92,5 +97,16 @@ module Skylight
       @normalizers.normalize(*args)
     end
 
+    # Starts the span with just its category, leaving the rest of the
+    # normalization to the worker
+    def defer(trace, name, cat, payload)
+      if span = trace.instrument(cat)
+        deferred = trace.deferred ||= Normalizers::Deferred.new(@normalizers, @instrumenter)
+        deferred.push(span, name, payload)
+      end
+
+      span
+    end
+
   end
 end
@@ -12,7 +12,6 @@ module Skylight
     autoload :Logging,        'skylight/util/logging'
     autoload :Queue,          'skylight/util/queue'
     autoload :Task,           'skylight/util/task'
-    autoload :UniformSample,  'skylight/util/uniform_sample'
     autoload :NativeExtFetcher, 'skylight/util/native_ext_fetcher'
   end
 end
\ No newline at end of file
@@ -40,6 +40,13 @@ module Skylight
         default.secs
       end
 
+      # Whether traces may read the time natively rather than through the
+      # default clock, see Messages::Trace::Builder. Only a plain Clock is
+      # read natively, so that a substituted clock still decides the time.
+      def self.native?
+        Skylight.native? && default.instance_of?(Clock)
+      end
+
       def self.default
         @clock ||= Clock.new
       end
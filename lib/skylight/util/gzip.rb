@@ -3,13 +3,71 @@ require 'zlib'
 module Skylight
   module Util
     module Gzip
-      def self.compress(str)
+      def self.compress(str, level = nil)
         output = StringIO.new
-        gz = Zlib::GzipWriter.new(output)
+        gz = Zlib::GzipWriter.new(output, level)
         gz.write(str)
         gz.close
         output.string
       end
+
+      # Reads another IO gzipped, compressing as it goes, so that a request
+      # body can be streamed without being compressed whole first
+      class Stream
+        CHUNK_SIZE = 16 * 1024
+
+        def initialize(io, level = nil)
+          @io = io
+          @level = level
+          reset
+        end
+
+        # Same contract as IO#read
+        def read(length = nil, outbuf = nil)
+          fill(length)
+
+          if length.nil?
+            str, @buf = @buf, ''.force_encoding(Encoding::BINARY)
+          elsif @buf.empty? && length > 0
+            return nil
+          else
+            str = @buf.slice!(0, length)
+          end
+
+          outbuf ? outbuf.replace(str) : str
+        end
+
+        def rewind
+          @io.rewind
+          reset
+          0
+        end
+
+        # Called by the GzipWriter with compressed output
+        def write(str)
+          @buf << str
+          str.bytesize
+        end
+
+      private
+
+        def reset
+          @buf = ''.force_encoding(Encoding::BINARY)
+          @eof = false
+          @gz = Zlib::GzipWriter.new(self, @level)
+        end
+
+        def fill(length)
+          until @eof || (length && @buf.bytesize >= length)
+            if chunk = @io.read(CHUNK_SIZE)
+              @gz.write(chunk)
+            else
+              @gz.finish
+              @eof = true
+            end
+          end
+        end
+      end
     end
   end
 end
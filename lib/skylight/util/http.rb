@@ -9,6 +9,8 @@ module Skylight
       CONTENT_ENCODING = 'content-encoding'.freeze
       CONTENT_LENGTH   = 'content-length'.freeze
       CONTENT_TYPE     = 'content-type'.freeze
+      TRANSFER_ENCODING = 'transfer-encoding'.freeze
+      CHUNKED          = 'chunked'.freeze
       ACCEPT           = 'Accept'.freeze
       X_VERSION_HDR    = 'x-skylight-agent-version'.freeze
       APPLICATION_JSON = 'application/json'.freeze
@@ -17,6 +19,9 @@ module Skylight
       GZIP             = 'gzip'.freeze
       DEFAULT_CA_FILE  = File.expand_path('../../data/cacert.pem', __FILE__)
 
+      # Seconds an idle connection is kept open for
+      KEEP_ALIVE = 120
+
       include Logging
 
       attr_accessor :authentication
@@ -27,6 +32,9 @@ module Skylight
       READ_EXCEPTIONS << Net::ReadTimeout if defined?(Net::ReadTimeout)
       READ_EXCEPTIONS.freeze
 
+      # Raised when the server closed a kept alive connection under us
+      STALE_EXCEPTIONS = [EOFError, IOError, Errno::ECONNRESET, Errno::EPIPE, Errno::ECONNABORTED].freeze
+
       class StartError < StandardError; end
       class ReadResponseError < StandardError; end
 
@@ -42,6 +50,7 @@ module Skylight
         @proxy_pass = config["#{service}.proxy_pass"]
 
         @timeout = opts[:timeout] || 15
+        @keep_alive = opts[:keep_alive] || KEEP_ALIVE
 
         unless @proxy_addr
           if http_proxy = ENV['HTTP_PROXY'] || ENV['http_proxy']
@@ -52,7 +61,14 @@ module Skylight
         end
 
         @deflate = config["#{service}.deflate"]
+        @deflate_level = config["#{service}.deflate_level"]
         @authentication = config[:'authentication']
+
+        @http = nil
+        @pid = nil
+        @reused = false
+        @last_used = 0
+        @lock = Mutex.new
       end
 
       def self.detect_ca_cert_file!
@@ -70,31 +86,67 @@ module Skylight
         @ca_cert_file
       end
 
+      # Loaded once per process rather than with every connection
+      def self.cert_store
+        @cert_store ||= begin
+          store = OpenSSL::X509::Store.new
+
+          if ca_cert_file?
+            store.set_default_paths
+          else
+            store.add_file(DEFAULT_CA_FILE)
+          end
+
+          store
+        end
+      end
+
       def get(endpoint, hdrs = {})
         request = build_request(Net::HTTP::Get, endpoint, hdrs)
         execute(request)
       end
 
+      # The body may also be an IO, which is streamed as it is read rather
+      # than loaded first. It is sent chunked unless its size is known and
+      # it is sent as is.
       def post(endpoint, body, hdrs = {})
+        # A body that comes with its own encoding is sent as is
+        encoded = hdrs.key?(CONTENT_ENCODING)
+
+        if body.respond_to?(:read)
+          length = body.size if (encoded || !@deflate) && body.respond_to?(:size)
+          request = build_request(Net::HTTP::Post, endpoint, hdrs, length, !length)
+
+          return execute(request, body, encoded)
+        end
+
         unless body.respond_to?(:to_str)
           hdrs[CONTENT_TYPE] = APPLICATION_JSON
           body = body.to_json
         end
 
         request = build_request(Net::HTTP::Post, endpoint, hdrs, body.bytesize)
-        execute(request, body)
+
+        execute(request, body, encoded)
+      end
+
+      # Closes the kept alive connection, if any. The next request opens a
+      # new one.
+      def close
+        @lock.synchronize { disconnect }
       end
 
     private
 
-      def build_request(type, endpoint, hdrs, length=nil)
+      def build_request(type, endpoint, hdrs, length=nil, chunked=false)
         headers = {}
 
-        headers[CONTENT_LENGTH]   = length.to_s if length
-        headers[AUTHORIZATION]    = authentication if authentication
-        headers[ACCEPT]           = APPLICATION_JSON
-        headers[X_VERSION_HDR]    = VERSION
-        headers[CONTENT_ENCODING] = GZIP if length && @deflate
+        headers[CONTENT_LENGTH]    = length.to_s if length
+        headers[TRANSFER_ENCODING] = CHUNKED if chunked
+        headers[AUTHORIZATION]     = authentication if authentication
+        headers[ACCEPT]            = APPLICATION_JSON
+        headers[X_VERSION_HDR]     = VERSION
+        headers[CONTENT_ENCODING]  = GZIP if (length || chunked) && @deflate
 
         hdrs.each do |k, v|
           headers[k] = v
@@ -103,52 +155,108 @@ module Skylight
         type.new(endpoint, headers)
       end
 
-      def do_request(http, req)
-        begin
-          client = http.start
-        rescue => e
-          # TODO: Retry here
-          raise StartError, e.inspect
+      def build_http
+        http = Net::HTTP.new(@host, @port, @proxy_addr, @proxy_port, @proxy_user, @proxy_pass)
+
+        http.open_timeout = @timeout
+        http.read_timeout = @timeout
+        http.keep_alive_timeout = @keep_alive if http.respond_to?(:keep_alive_timeout=)
+
+        if @ssl
+          http.use_ssl = true
+          http.cert_store = HTTP.cert_store
+          http.verify_mode = OpenSSL::SSL::VERIFY_PEER
+        end
+
+        http
+      end
+
+      # The connection is opened by the first request and kept open between
+      # requests until it has been idle for @keep_alive seconds. The same
+      # Net::HTTP object opens every connection, so reconnecting resumes the
+      # previous TLS session instead of doing a full handshake.
+      def connection
+        # A connection inherited from the parent process is left to it
+        @http = nil if @pid != Process.pid
+        @pid = Process.pid
+
+        @http ||= build_http
+
+        if @http.started? && Util::Clock.absolute_secs - @last_used > @keep_alive
+          disconnect
+        end
+
+        @reused = @http.started?
+
+        unless @reused
+          begin
+            @http.start
+          rescue => e
+            raise StartError, e.inspect
+          end
         end
 
+        @http
+      end
+
+      def disconnect
+        @http.finish if @http && @http.started?
+      rescue IOError
+      end
+
+      # A GET on a kept alive connection the server has since closed is
+      # retried once on a new connection. Other requests are not, as the
+      # server may have acted on them before the connection went away; a
+      # failed report is spooled and sent again later instead.
+      def do_request(req)
+        retried = false
+
         begin
-          res = client.request(req)
+          res = connection.request(req)
+        rescue *STALE_EXCEPTIONS => e
+          disconnect
+
+          if @reused && !retried && Net::HTTP::Get === req
+            retried = true
+            debug "kept alive connection was closed; reconnecting"
+            retry
+          end
+
+          raise ReadResponseError, e.inspect
         rescue *READ_EXCEPTIONS => e
+          disconnect
           raise ReadResponseError, e.inspect
+        rescue Exception
+          disconnect
+          raise
         end
 
+        @last_used = Util::Clock.absolute_secs
+
         yield res
-      ensure
-        client.finish if client
       end
 
-      def execute(req, body=nil)
+      def execute(req, body=nil, encoded=false)
         t { fmt "executing HTTP request; host=%s; port=%s; path=%s, body=%s",
-              @host, @port, req.path, body && body.bytesize }
+              @host, @port, req.path, body && (body.respond_to?(:read) ? "stream" : body.bytesize) }
 
-        if body
-          body = Gzip.compress(body) if @deflate
+        if body.respond_to?(:read)
+          body = Gzip::Stream.new(body, @deflate_level) if @deflate && !encoded
+          req.body_stream = body
+        elsif body
+          body = Gzip.compress(body, @deflate_level) if @deflate && !encoded
           req.body = body
         end
 
-        http = Net::HTTP.new(@host, @port, @proxy_addr, @proxy_port, @proxy_user, @proxy_pass)
-
-        http.open_timeout = @timeout
-        http.read_timeout = @timeout
-
-        if @ssl
-          http.use_ssl = true
-          http.ca_file = DEFAULT_CA_FILE unless HTTP.ca_cert_file?
-          http.verify_mode = OpenSSL::SSL::VERIFY_PEER
-        end
+        @lock.synchronize do
+          do_request(req) do |res|
+            unless res.code =~ /2\d\d/
+              debug "server responded with #{res.code}"
+              t { fmt "body=%s", res.body }
+            end
 
-        do_request(http, req) do |res|
-          unless res.code =~ /2\d\d/
-            debug "server responded with #{res.code}"
-            t { fmt "body=%s", res.body }
+            Response.new(res.code.to_i, res, res.body)
           end
-
-          Response.new(res.code.to_i, res, res.body)
         end
       rescue Exception => e
         error "http %s %s failed; error=%s; msg=%s", req.method, req.path, e.class, e.message
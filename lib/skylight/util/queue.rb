@@ -12,13 +12,24 @@ module Skylight
         end
 
         @max     = max
-        @values  = [nil] * max
+        # One slot is always left open so that a full queue can be told
+        # apart from an empty one
+        @values  = [nil] * (max + 1)
         @consume = 0
         @produce = 0
         @waiting = nil
         @mutex   = Mutex.new
+
+        @drops      = 0
+        @high_water = 0
       end
 
+      # Number of pushes rejected because the queue was full
+      attr_reader :drops
+
+      # Largest number of items the queue has held
+      attr_reader :high_water
+
       def empty?
         @mutex.synchronize { __empty? }
       end
@@ -32,11 +43,16 @@ module Skylight
         ret = nil
 
         @mutex.synchronize do
-          return if __length == @max
+          if __length == @max
+            @drops += 1
+            return
+          end
+
           @values[@produce] = obj
-          @produce = (@produce + 1) % @max
+          @produce = (@produce + 1) % @values.length
 
           ret = __length
+          @high_water = ret if ret > @high_water
 
           # Wakeup a blocked thread
           if t = @waiting
@@ -47,6 +63,19 @@ module Skylight
         ret
       end
 
+      # Removes and returns up to `max` items without blocking
+      def drain(max)
+        ret = []
+
+        @mutex.synchronize do
+          while ret.length < max && !__empty?
+            ret << __pop
+          end
+        end
+
+        ret
+      end
+
       def pop(timeout = nil)
         if timeout && timeout < 0
           raise ArgumentError, "timeout must be nil or >= than 0"
@@ -74,7 +103,7 @@ module Skylight
     private
 
       def __length
-        ((@produce - @consume) % @max)
+        ((@produce - @consume) % @values.length)
       end
 
       def __empty?
@@ -86,7 +115,7 @@ module Skylight
         v = @values[i]
 
         @values[i] = nil
-        @consume = (i + 1) % @max
+        @consume = (i + 1) % @values.length
 
         return v
       end
@@ -8,17 +8,22 @@ module Skylight
       # Requires the subclass to define `config`
       include Util::Logging
 
-      attr_reader :queue_depth_metric
+      attr_reader :queue_depth_metric, :queue_drops_metric, :queue_high_water_metric
 
-      def initialize(size, timeout = 0.1, &blk)
+      # When `batch` is set, messages are handled in Arrays of up to `batch`
+      # messages, taken off the queue at once.
+      def initialize(size, timeout = 0.1, batch = nil, &blk)
         @pid = Process.pid
         @thread = nil
         @size = size
         @lock = Mutex.new
         @timeout = timeout
+        @batch = batch
         @blk = blk
 
         @queue_depth_metric = build_queue_depth_metric
+        @queue_drops_metric = build_queue_metric(:drops)
+        @queue_high_water_metric = build_queue_metric(:high_water)
       end
 
       def submit(msg, pid = Process.pid)
@@ -86,7 +91,7 @@ module Skylight
         @lock.synchronize do
           return if spawned? && @pid == pid
           @pid    = Process.pid
-          @queue  = Util::Queue.new(@size)
+          @queue  = build_queue
           @thread = Thread.new do
             begin
               prepare
@@ -113,10 +118,13 @@ module Skylight
         while @pid
           if msg = q.pop(@timeout)
             return true if SHUTDOWN == msg
+            msg, shutdown = batch(q, msg) if @batch
 
             unless __handle(msg)
               return false
             end
+
+            return true if shutdown
           else
             return unless @queue
             # just a tick
@@ -129,15 +137,31 @@ module Skylight
         # Drain the queue
         while msg = q.pop(0)
           return true if SHUTDOWN == msg
+          msg, shutdown = batch(q, msg) if @batch
 
           unless __handle(msg)
             return false
           end
+
+          return true if shutdown
         end
 
         true
       end
 
+      # Takes up to `@batch` messages off the queue, starting with `msg`.
+      # Returns them along with whether a shutdown was requested.
+      def batch(q, msg)
+        msgs = [msg]
+
+        q.drain(@batch - 1).each do |m|
+          return msgs, true if SHUTDOWN == m
+          msgs << m
+        end
+
+        return msgs, false
+      end
+
       def __handle(msg)
         begin
           handle(msg)
@@ -160,6 +184,15 @@ module Skylight
       def finish
       end
 
+      # Pushes never contend on a lock with the native queue
+      def build_queue
+        if Skylight.native?
+          Skylight::MpscQueue.native_new(@size)
+        else
+          Util::Queue.new(@size)
+        end
+      end
+
       def build_queue_depth_metric
         lambda do
           q = @queue
@@ -167,6 +200,13 @@ module Skylight
         end
       end
 
+      def build_queue_metric(name)
+        lambda do
+          q = @queue
+          q ? q.send(name) : 0
+        end
+      end
+
     end
   end
 end
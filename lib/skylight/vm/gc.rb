@@ -28,6 +28,25 @@ module Skylight
       #   end
       # end
 
+    elsif Skylight.native? && GcTracker.native_supported?
+
+      # Reads the GC time tracked by the native extension from the VM's GC
+      # events. The total only grows, so it is safe to read from any thread,
+      # see Skylight::GC.
+      class GC
+        def enable
+          GcTracker.native_enable
+        end
+
+        def total_time
+          GcTracker.native_total_time
+        end
+
+        def monotonic?
+          true
+        end
+      end
+
     elsif defined?(::GC::Profiler)
 
       class GC
@@ -40,8 +59,8 @@ module Skylight
         end
 
         def total_time
-          # Reported in seconds
-          run = (::GC::Profiler.total_time * 1_000_000).to_i
+          # Reported in seconds, kept in nanoseconds like GcTracker's
+          run = (::GC::Profiler.total_time * 1_000_000_000).to_i
 
           if run > 0
             ::GC::Profiler.clear
@@ -13,6 +13,7 @@ module Skylight
     autoload :Embedded,        'skylight/worker/embedded'
     autoload :MetricsReporter, 'skylight/worker/metrics_reporter'
     autoload :Server,          'skylight/worker/server'
+    autoload :Spool,           'skylight/worker/spool'
     autoload :Standalone,      'skylight/worker/standalone'
 
   end
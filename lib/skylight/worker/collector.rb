@@ -26,6 +26,9 @@ module Skylight
         @report_meter = Metrics::Meter.new
         @report_success_meter = Metrics::Meter.new
         @metrics_reporter = metrics_reporter
+        @spool = nil
+        @drain_at = 0
+        @shards = nil
 
         @metrics_reporter.register("collector.report-rate", @report_meter)
         @metrics_reporter.register("collector.report-success-rate", @report_success_meter)
@@ -38,8 +41,13 @@ module Skylight
       end
 
       def prepare
+        @spool = build_spool
+        @shards = build_shards
+
         if @metrics_reporter
           @metrics_reporter.register("worker.collector.queue-depth", queue_depth_metric)
+          @metrics_reporter.register("worker.collector.queue-drops", queue_drops_metric)
+          @metrics_reporter.register("worker.collector.queue-high-water", queue_high_water_metric)
           @metrics_reporter.spawn
         end
       end
@@ -54,6 +62,9 @@ module Skylight
         if @batch.should_flush?(now)
           if has_report_token?(now)
             flush(@batch)
+          elsif @spool
+            warn "do not have valid session token -- spooling"
+            spool(@batch)
           else
             warn "do not have valid session token -- dropping"
             return true
@@ -62,6 +73,13 @@ module Skylight
           @batch = new_batch(now)
         end
 
+        # Replays one spooled batch per interval, so that catching up after
+        # an outage doesn't hold up the traces coming in meanwhile
+        if @spool && now >= @drain_at && has_report_token?(now)
+          @drain_at = now + @interval
+          @spool.drain(now) { |body, gzip| report(body, gzip, false) }
+        end
+
         return true unless msg
 
         case msg
@@ -133,12 +151,19 @@ module Skylight
           refresh_report_token(now)
         end
 
-        if @batch && has_report_token?(now)
-          flush(@batch)
+        if @batch
+          if has_report_token?(now)
+            flush(@batch)
+          elsif @spool
+            spool(@batch)
+          end
         end
 
         @batch = nil
       ensure
+        @http_report.close if @http_report
+        @http_auth.close
+
         if @metrics_reporter
           @metrics_reporter.shutdown
         end
@@ -147,18 +172,66 @@ module Skylight
       def flush(batch)
         return if batch.empty?
 
-        debug "flushing batch; size=%d", batch.sample.count
+        debug "flushing batch; size=%d", batch.sample.native_count
+
+        body, gzip = encode(batch)
+
+        unless report(body, gzip)
+          @spool.push(body, gzip) if @spool
+        end
+
+        nil
+      end
+
+      def spool(batch)
+        return if batch.empty?
+
+        debug "spooling batch; size=%d", batch.sample.native_count
+
+        @spool.push(*encode(batch))
+      end
 
+      # Compresses while encoding when the extension can, so the raw batch
+      # never exists in full; otherwise Util::HTTP gzips it
+      def encode(batch)
+        if config[:'report.deflate'] && Skylight::Batch::NATIVE_GZIP
+          [batch.encode(config[:'report.deflate_level']), true]
+        else
+          [batch.encode, false]
+        end
+      end
+
+      # Returns false if the batch should be retried later
+      def report(body, gzip, notify = true)
         @report_meter.mark
 
-        res = @http_report.post(ENDPOINT, batch.encode, CONTENT_TYPE => SKYLIGHT_V2)
+        headers = { CONTENT_TYPE => SKYLIGHT_V2 }
+        headers[Util::HTTP::CONTENT_ENCODING] = Util::HTTP::GZIP if gzip
+
+        res = @http_report.post(ENDPOINT, body, headers)
 
         if res.exception
-          send_http_exception(@http_report, res)
+          send_http_exception(@http_report, res) if notify
+          false
+        elsif res.status >= 500
+          warn "report failed; status=%s", res.status
+          false
         else
           @report_success_meter.mark
+          true
         end
+      end
+
+      def build_spool
+        return unless config[:'agent.spool_max_size'].to_i > 0
 
+        path = config[:'agent.spool_path']
+        path ||= File.join(config[:'agent.sockfile_path'], 'spool') if config[:'agent.sockfile_path']
+        return unless path
+
+        Spool.new(config, path, config[:'agent.spool_max_size'].to_i)
+      rescue SystemCallError => e
+        error "could not open report spool; path=%s; msg=%s", path, e.message
         nil
       end
 
@@ -173,6 +246,7 @@ module Skylight
         unless res.success?
           if (400..499).include? res.status
             warn "token request rejected; status=%s", res.status
+            @http_report.close if @http_report
             @http_report = nil
           end
 
@@ -185,7 +259,8 @@ module Skylight
 
         if tok
           @refresh_at  = now + 1800 # 30 minutes
-          @http_report = Util::HTTP.new(config, :report)
+          # Keeps its connection open across refreshes
+          @http_report ||= Util::HTTP.new(config, :report)
           @http_report.authentication = tok
         else
           if @http_report
@@ -209,7 +284,20 @@ module Skylight
       end
 
       def new_batch(now)
-        Batch.new(config, @size, round(now), @interval)
+        Batch.new(config, @size, round(now), @interval, @shards)
+      end
+
+      # Started from the collector thread, so they never exist in a process
+      # that forks
+      def build_shards
+        shards = config[:'agent.ingest_shards'].to_i
+        return unless shards > 0
+
+        debug "starting ingest shards; shards=%d", shards
+        Skylight::IngestShards.native_new(shards, @size, config[:'agent.sample_strategy'].to_s == 'weighted')
+      rescue SystemCallError => e
+        warn "could not start ingest shards, ingesting on the collector thread; err=%s", e.message
+        nil
       end
 
       def round(time)
@@ -219,44 +307,65 @@ module Skylight
       class Batch
         include Util::Logging
 
-        attr_reader :config, :from, :counts, :sample, :flush_at
+        attr_reader :config, :from, :counter, :sample, :flush_at
 
-        def initialize(config, size, from, interval)
+        # With shards, traces are counted and sampled by the shards' threads
+        # and only merged into this batch when it is about to be flushed
+        def initialize(config, size, from, interval, shards = nil)
           @config   = config
           @from     = from
           @flush_at = from + interval
-          @sample   = Util::UniformSample.new(size)
-          @counts   = Hash.new(0)
+          @sample   = Skylight::Reservoir.native_new(size, config[:'agent.sample_strategy'].to_s == 'weighted')
+          @counter  = Skylight::EndpointCounter.native_new
+          @shards   = shards
         end
 
         def should_flush?(now)
-          return true if @config.constant_flush?
-          now >= @flush_at
+          flush = @config.constant_flush? || now >= @flush_at
+          merge_shards if flush
+          flush
         end
 
         def empty?
-          @sample.empty?
+          merge_shards
+          @sample.native_count == 0
         end
 
         def push(trace)
-          # Count it
-          @counts[trace.endpoint_name] += 1
-          # Push the trace into the sample
-          @sample << trace
+          # Hashed onto the shard of its endpoint, which does the rest
+          if @shards
+            @shards.native_push(trace.data)
+            return
+          end
+
+          # Count it against its endpoint natively, reading the name out of
+          # the serialized trace rather than building a Ruby string for it.
+          # Its spans are rolled up here too, before sampling, so that the
+          # traces left out of the sample still show in the span timings.
+          return unless @counter.native_push(trace.data)
+          # Offer the trace bytes to the sample, which copies them into its
+          # arena so the envelope can be collected right away
+          @sample.native_push(trace.data)
         end
 
-        def encode
-          batch = Skylight::Batch.native_new(from, config[:hostname])
+        # Gzips the batch when given a compression level
+        def encode(level = nil)
+          merge_shards
+          # Writes the already serialized traces straight into the encoded
+          # batch without decoding or copying them into an intermediate batch
+          Skylight::Batch.native_encode(from, config[:hostname], @counter, @sample, level)
+        end
 
-          sample.each do |trace|
-            batch.native_move_in(trace.data)
-          end
+        private
 
-          @counts.each do |endpoint_name,count|
-            batch.native_set_endpoint_count(endpoint_name, count)
-          end
+        # Folds in whatever the shards took in since they were last merged
+        def merge_shards
+          return unless @shards && @shards.native_count > 0
+          @shards.native_drain(@counter, @sample)
 
-          batch.native_serialize
+          if (failures = @shards.native_failures) > 0
+            warn "ingest shards ran out of memory; traces dropped=%d", failures
+          end
         end
       end
 
@@ -2,84 +2,89 @@ module Skylight
   module Worker
     # Represents the IPC client connection
     class Connection
-      FRAME_HDR_LEN = 8
+      RING_NAME = /\Askylight-[\w-]+\.ring\z/
 
       attr_reader :sock, :throughput
 
-      def initialize(sock)
+      def initialize(sock, sockfile_path = nil)
         @sock = sock
-        @len  = nil
-        @buf  = ""
+        @reader = Skylight::FrameReader.native_new
+        @frames = []
+        @ring = nil
+        @sockfile_path = sockfile_path
 
         # Metrics
         @throughput = Metrics::Meter.new
       end
 
       def read
-        if msg = maybe_read_message
-          return msg
-        end
-
-        if chunk = read_sock
-
-          @buf << chunk
-
-          if !@len && @buf.bytesize >= FRAME_HDR_LEN
-            @len = read_len
+        while true
+          if @ring && data = @ring.native_shift
+            @throughput.mark(data.bytesize)
+            return Messages::TraceEnvelope.deserialize(data)
           end
 
-          maybe_read_message
+          case msg = read_frame
+          when Messages::RingAttach
+            attach_ring(msg.name)
+          when Messages::RingWakeup
+            # Drain the ring on the next pass
+          else
+            return msg
+          end
         end
       end
 
       def cleanup
-        # Any cleanup code here
+        @ring.native_close if @ring
+        @ring = nil
       end
 
     private
 
-      def read_len
-        if len = @buf[4, 4]
-          len.unpack("L")[0]
+      # Returns the next frame received on the socket, decoded. Frames are
+      # decoded natively, all that are complete at once, so a backed up
+      # socket costs no more per message than an idle one.
+      def read_frame
+        if @frames.empty?
+          bytes = @reader.native_read(@sock.fileno, @frames)
+          # Track the throughput
+          @throughput.mark(bytes) if bytes > 0
+          return if @frames.empty?
         end
-      end
 
-      def read_message_id
-        if win = @buf[0, 4]
-          win.unpack("L")[0]
+        mid  = @frames.shift
+        data = @frames.shift
+
+        klass = Messages::ID_TO_KLASS.fetch(mid) do
+          raise IpcProtoError, "unknown message `#{mid}`"
+        end
+
+        begin
+          klass.deserialize(data)
+        rescue Exception => e
+          # reraise protobuf decoding exceptions
+          raise IpcProtoError, e.message
         end
       end
 
-      def maybe_read_message
-        if @len && @buf.bytesize >= @len + FRAME_HDR_LEN
-          mid   = read_message_id
-          klass = Messages::ID_TO_KLASS.fetch(mid) do
-            raise IpcProtoError, "unknown message `#{mid}`"
-          end
-          data  = @buf[FRAME_HDR_LEN, @len]
-          @buf  = @buf[(FRAME_HDR_LEN + @len)..-1] || ""
+      def attach_ring(name)
+        unless @sockfile_path && name =~ RING_NAME
+          raise IpcProtoError, "invalid IPC ring `#{name}`"
+        end
 
-          if @buf.bytesize >= FRAME_HDR_LEN
-            @len = read_len
-          else
-            @len = nil
-          end
+        path = "#{@sockfile_path}/#{name}"
 
-          begin
-            return klass.deserialize(data)
-          rescue Exception => e
-            # reraise protobuf decoding exceptions
-            raise IpcProtoError, e.message
-          end
+        begin
+          ring = Skylight::Ring.native_open(path)
+        rescue SystemCallError, ArgumentError => e
+          raise IpcProtoError, "could not attach IPC ring; #{e.message}"
+        ensure
+          File.unlink(path) rescue nil
         end
-      end
 
-      def read_sock
-        ret = @sock.read_nonblock(CHUNK_SIZE)
-        # Track the throughput
-        @throughput.mark(ret.bytesize) if ret
-        ret
-      rescue Errno::EAGAIN, Errno::EWOULDBLOCK
+        cleanup
+        @ring = ring
       end
 
     end
@@ -5,7 +5,8 @@ module Skylight
     class ConnectionSet
       attr_reader :open_connections, :throughput
 
-      def initialize
+      def initialize(sockfile_path = nil)
+        @sockfile_path = sockfile_path
         @connections = {}
         @lock = Mutex.new
 
@@ -15,7 +16,7 @@ module Skylight
       end
 
       def add(sock)
-        conn = Connection.new(sock)
+        conn = Connection.new(sock, @sockfile_path)
         @lock.synchronize { @connections[sock] = conn }
         conn
       end
@@ -14,8 +14,12 @@ module Skylight
       end
 
       def submit(msg)
+        msg.apply_deferred if Skylight::Trace === msg
+
         decoder = Messages::ID_TO_KLASS.fetch(Messages::KLASS_TO_ID.fetch(msg.class))
-        msg = decoder.deserialize(msg.serialize)
+        data = msg.serialize
+        msg.recycle if Skylight::Trace === msg
+        msg = decoder.deserialize(data)
 
         @collector.submit(msg)
       end
@@ -8,6 +8,16 @@ module Skylight
       UDS_SRV_FD_KEY     = 'SKYLIGHT_UDS_FD'.freeze
       KEEPALIVE_KEY      = 'SKYLIGHT_KEEPALIVE'.freeze
 
+      # Worker health metrics read natively from /proc, see SharedSampler
+      HEALTH_GAUGES = {
+        "worker.faults.minor"                 => :minor_faults,
+        "worker.faults.major"                 => :major_faults,
+        "worker.context-switches.voluntary"   => :voluntary_switches,
+        "worker.context-switches.involuntary" => :involuntary_switches,
+        "worker.open-fds"                     => :open_fds,
+        "worker.threads"                      => :threads
+      }.freeze
+
       include Util::Logging
 
       attr_reader \
@@ -29,17 +39,23 @@ module Skylight
         @run = true
         @tick = 1
         @socks = []
+
+        # Client sockets by fd, and the fds found ready, when polling
+        @clients = {}
+        @ready = []
+        @poller = nil
         @config = config
         @server = srv
         @lockfile = lockfile
         @collector = Collector.build(config)
         @metrics_reporter = @collector.metrics_reporter
         @keepalive = @config[:'agent.keepalive']
-        @connections = ConnectionSet.new
         @lockfile_path = lockfile_path
         @sockfile_path = @config[:'agent.sockfile_path']
-        @process_mem_gauge = Metrics::ProcessMemGauge.new
-        @process_cpu_gauge = Metrics::ProcessCpuGauge.new
+        @connections = ConnectionSet.new(@sockfile_path)
+        @proc_sampler = Metrics.proc_sampler
+        @process_mem_gauge = Metrics::ProcessMemGauge.new(30, Util::Clock.default, @proc_sampler)
+        @process_cpu_gauge = Metrics::ProcessCpuGauge.new(5, Util::Clock.default, @proc_sampler)
         @max_memory = @config[:'agent.max_memory']
         @booted_at = Util::Clock.absolute_secs
       end
@@ -139,6 +155,12 @@ module Skylight
         @metrics_reporter.register("worker.ipc.open-connections", @connections.open_connections)
         @metrics_reporter.register("worker.ipc.throughput", @connections.throughput)
 
+        if @proc_sampler
+          HEALTH_GAUGES.each do |name, field|
+            @metrics_reporter.register(name, Metrics::ProcessHealthGauge.new(@proc_sampler, field))
+          end
+        end
+
         info "starting skylight daemon"
         @collector.spawn
       end
@@ -146,6 +168,7 @@ module Skylight
       def work
         t { "server working" }
         @socks << @server
+        @poller = build_poller
 
         now = Time.now.to_i
         next_sanity_check_at = now + tick
@@ -154,39 +177,12 @@ module Skylight
 
         trace "starting IO loop"
         begin
-          # Wait for something to do
-          r, _, _ = IO.select(@socks, [], [], tick)
-
-          if r
-            r.each do |sock|
-              if sock == @server
-                # If the server socket, accept
-                # the incoming connection
-                if client = accept
-                  connect(client)
-                end
-              else
-                # Client socket, lookup the associated connection
-                # state machine.
-                unless conn = @connections[sock]
-                  # No associated connection, weird.. bail
-                  client_close(sock)
-                  next
-                end
-
-                begin
-                  # Pop em while we got em
-                  while msg = conn.read
-                    handle(msg)
-                  end
-                rescue SystemCallError, EOFError
-                  client_close(sock)
-                rescue IpcProtoError => e
-                  error "Server#work - IPC protocol exception: %s", e.message
-                  client_close(sock)
-                end
-              end
-            end
+          # Wait for something to do. With the poller, the checks below only
+          # run when its timer fires.
+          if @poller
+            next unless poll_clients > 0
+          else
+            select_clients
           end
 
           now = Time.now.to_i
@@ -228,10 +224,93 @@ module Skylight
 
         true # Successful return
       ensure
+        if @poller
+          @poller.native_close
+          @poller = nil
+        end
+
         # Send a final metrics report
         @metrics_reporter.post_report
       end
 
+      # Waits on every socket with IO.select, handling the ones that are
+      # ready
+      def select_clients
+        r, _, _ = IO.select(@socks, [], [], tick)
+
+        if r
+          r.each do |sock|
+            if sock == @server
+              # If the server socket, accept
+              # the incoming connection
+              if client = accept
+                connect(client)
+              end
+            else
+              read_client(sock)
+            end
+          end
+        end
+      end
+
+      # Waits on the poller, handling the sockets that are ready. Returns the
+      # number of times the timer fired.
+      def poll_clients
+        expirations = @poller.native_wait(@ready)
+
+        @ready.each do |fd|
+          if fd == @server.fileno
+            # The server socket is edge triggered, so accept until there
+            # are no more pending connections
+            while client = accept
+              connect(client)
+            end
+          elsif sock = @clients[fd]
+            read_client(sock)
+          else
+            @poller.native_remove(fd)
+          end
+        end
+
+        expirations
+      ensure
+        @ready.clear
+      end
+
+      def read_client(sock)
+        # Client socket, lookup the associated connection
+        # state machine.
+        unless conn = @connections[sock]
+          # No associated connection, weird.. bail
+          client_close(sock)
+          return
+        end
+
+        begin
+          # Pop em while we got em
+          while msg = conn.read
+            handle(msg)
+          end
+        rescue SystemCallError, EOFError
+          client_close(sock)
+        rescue IpcProtoError => e
+          error "Server#work - IPC protocol exception: %s", e.message
+          client_close(sock)
+        end
+      end
+
+      def build_poller
+        return unless Skylight.native? && defined?(Skylight::Poller)
+
+        poller = Skylight::Poller.native_new
+        poller.native_add(@server.fileno, true)
+        poller.native_timer(tick * 1000)
+        poller
+      rescue SystemCallError => e
+        debug "could not set up the poller, using IO.select; err=%s", e.message
+        nil
+      end
+
       # Handles an incoming message. Will be instances from
       # the Messages namespace
       def handle(msg)
@@ -263,15 +342,25 @@ module Skylight
         Server.exec(hello.cmd, @config, @lockfile, @server, lockfile_path)
       end
 
+      # Returns nil once there are no more connections waiting. One that
+      # was aborted before it could be accepted is skipped, not taken for
+      # the end of the queue.
       def accept
         @server.accept_nonblock
-      rescue Errno::EWOULDBLOCK, Errno::EAGAIN, Errno::ECONNABORTED
+      rescue Errno::ECONNABORTED
+        retry
+      rescue Errno::EWOULDBLOCK, Errno::EAGAIN
       end
 
       def connect(sock)
         trace "client accepted"
         @socks << sock
         @connections.add(sock)
+
+        if @poller
+          @clients[sock.fileno] = sock
+          @poller.native_add(sock.fileno, false)
+        end
       end
 
       def cleanup
@@ -296,6 +385,7 @@ module Skylight
 
       def client_close(sock)
         trace "closing client connection; fd=%d", sock.fileno
+        @clients.delete(sock.fileno) if @clients[sock.fileno] == sock
         @connections.cleanup(sock)
         @socks.delete(sock)
       end
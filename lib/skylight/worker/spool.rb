@@ -0,0 +1,146 @@
+require 'fileutils'
+
+module Skylight
+  module Worker
+    # Keeps encoded batches that could not be reported on disk, so that they
+    # can be reported once the endpoint is reachable again, including by the
+    # next worker should this one exit first.
+    #
+    # Every batch is a file of its own, written to a temporary path and then
+    # renamed into place, so a crash can never leave a partial batch behind.
+    # File names sort in the order batches were spooled in. Once the spool
+    # grows past its maximum size the oldest batches are dropped.
+    class Spool
+      include Util::Logging
+
+      GZIP_EXT  = '.gz'.freeze
+      PLAIN_EXT = '.pb'.freeze
+      TMP_EXT   = '.tmp'.freeze
+
+      # Seconds to wait before retrying after a failed report
+      MIN_BACKOFF = 5
+      MAX_BACKOFF = 300
+
+      attr_reader :config, :path, :max_size, :bytesize
+
+      def initialize(config, path, max_size)
+        @config   = config
+        @path     = path
+        @max_size = max_size
+        @files    = []
+        @bytesize = 0
+        @seq      = 0
+        @backoff  = 0
+        @retry_at = 0
+
+        load
+      end
+
+      def length
+        @files.length
+      end
+
+      def empty?
+        @files.empty?
+      end
+
+      # Stores an encoded batch. Returns false if it could not be stored.
+      def push(body, gzip)
+        return false if body.bytesize > @max_size
+
+        while @bytesize + body.bytesize > @max_size
+          warn "report spool full; dropping oldest batch"
+          delete(@files.first)
+        end
+
+        @seq += 1
+        file = File.join(@path, "%010d-%06d%s" % [Time.now.to_i, @seq, gzip ? GZIP_EXT : PLAIN_EXT])
+        tmp  = "#{file}#{TMP_EXT}"
+
+        File.open(tmp, 'wb') { |f| f.write(body) }
+        File.rename(tmp, file)
+
+        @files << file
+        @bytesize += body.bytesize
+
+        t { fmt "spooled batch; file=%s; size=%d", file, body.bytesize }
+
+        true
+      rescue SystemCallError, IOError => e
+        error "could not spool batch; msg=%s", e.message
+
+        if tmp
+          File.unlink(tmp) rescue nil
+        end
+
+        false
+      end
+
+      # Yields the oldest batch, and whether it is gzipped, unless a previous
+      # attempt failed recently. The batch is removed when the block returns
+      # true; otherwise further attempts back off exponentially.
+      def drain(now)
+        return if @files.empty? || now < @retry_at
+
+        file = @files.first
+
+        # The batch is streamed from the file as it is reported
+        begin
+          body = File.open(file, 'rb')
+        rescue SystemCallError, IOError => e
+          warn "could not read spooled batch; file=%s; msg=%s", file, e.message
+          delete(file)
+          return
+        end
+
+        begin
+          reported = yield(body, file.end_with?(GZIP_EXT))
+        ensure
+          body.close
+        end
+
+        if reported
+          delete(file)
+          @backoff = 0
+          @retry_at = 0
+        else
+          @backoff = @backoff == 0 ? MIN_BACKOFF : [@backoff * 2, MAX_BACKOFF].min
+          @retry_at = now + @backoff
+          debug "could not report spooled batch; retrying in %ds", @backoff
+        end
+      end
+
+    private
+
+      # Picks up the batches left behind by a previous worker
+      def load
+        FileUtils.mkdir_p(@path)
+
+        Dir[File.join(@path, "*#{TMP_EXT}")].each do |tmp|
+          File.unlink(tmp) rescue nil
+        end
+
+        @files = Dir[File.join(@path, "*{#{GZIP_EXT},#{PLAIN_EXT}}")].sort
+        @bytesize = @files.inject(0) { |sum, file| sum + (File.size(file) rescue 0) }
+
+        # Stay under the limit even if it was lowered since
+        while @bytesize > @max_size
+          delete(@files.first)
+        end
+
+        unless @files.empty?
+          info "replaying spooled batches; count=%d; size=%d", @files.length, @bytesize
+        end
+      end
+
+      def delete(file)
+        @files.delete(file)
+        @bytesize -= File.size(file)
+        File.unlink(file)
+      rescue SystemCallError
+      ensure
+        @bytesize = 0 if @files.empty?
+      end
+    end
+  end
+end
@@ -42,6 +42,14 @@ module Skylight
       # Used to handle starting the thread
       LOCK = Mutex.new
 
+      # Messages waiting to be written to the agent
+      QUEUE_SIZE = 1000
+
+      # Messages the writer takes off the queue at once, and the number of
+      # buffered bytes that triggers a write before the batch is done
+      WRITE_BATCH  = 100
+      WRITE_BUDGET = 256 * 1024
+
       attr_reader \
         :pid,
         :config,
@@ -54,6 +62,8 @@ module Skylight
       def initialize(config, lockfile, server)
         @pid  = nil
         @sock = nil
+        @ring = nil
+        @frames = Skylight::FrameWriter.native_new
 
         unless config && lockfile && server
           raise ArgumentError, "all arguments are required"
@@ -66,6 +76,8 @@ module Skylight
         @lockfile = lockfile
         @keepalive = config[:'agent.keepalive']
         @sockfile_path = config[:'agent.sockfile_path']
+        @ipc_ring = config[:'agent.ipc'].to_s == 'ring'
+        @rings = 0
 
         # Should be configurable
         @max_spawns = 3
@@ -147,6 +159,7 @@ module Skylight
               if sock = connect(pid)
                 trace "connected to unix socket; pid=%s", pid
                 write_msg(sock, build_hello)
+                attach_ring(sock, pid)
                 @sock = sock
                 @pid  = pid
                 return true
@@ -174,6 +187,7 @@ module Skylight
         # just fine.
         if sock = connect(@pid)
           t { "reconnected to worker" }
+          attach_ring(sock, @pid)
           @sock = sock
           # TODO: Should HELLO be sent again?
           return true
@@ -193,15 +207,23 @@ module Skylight
         true
       end
 
-      def writer_tick(msg)
-        if :SHUTDOWN == msg
-          trace "shuting down agent connection"
-          @sock.close if @sock
-          @pid = nil
+      def writer_tick(msgs)
+        if msgs
+          msgs.each do |msg|
+            if :SHUTDOWN == msg
+              flush
+              trace "shuting down agent connection"
+              @sock.close if @sock
+              close_ring
+              @pid = nil
+
+              return false
+            end
+
+            return false unless handle(msg)
+          end
 
-          return false
-        elsif msg
-          return handle(msg)
+          return flush
         else
           begin
             @sock.read_nonblock(1)
@@ -220,30 +242,61 @@ module Skylight
         return false
       end
 
+      # Buffers the message, writing the buffer out once it is over budget
       def handle(msg)
+        msg.apply_deferred if Skylight::Trace === msg
+
+        if @ring && Skylight::Trace === msg
+          return true if push_ring(msg)
+        end
+
+        t { "buffering a #{msg.class} for the wire" }
+
+        if Skylight::Trace === msg
+          @frames.native_push_trace(msg)
+          msg.recycle
+        else
+          @frames.native_push(Messages::KLASS_TO_ID.fetch(msg.class), msg.serialize)
+        end
+
+        @frames.native_length < WRITE_BUDGET || flush
+      end
+
+      # Writes out every buffered message, coalesced into as few syscalls as
+      # the socket allows
+      def flush
+        return true if @frames.native_length == 0
+
         2.times do
           unless sock = @sock
             return false unless repair
             sock = @sock
           end
 
-          if write_msg(sock, msg)
+          if write_frames(sock)
             return true
           end
 
           @sock = nil
           sock.close rescue nil
 
+          if @frames.native_restart > 0
+            debug "dropped a partially written message"
+          end
+
           unless repair
             return false
           end
         end
 
-        debug "could not handle message; msg=%s", msg.class
+        debug "could not write messages; bytes=%d", @frames.native_length
+        @frames.native_clear
 
         false
       end
 
+      # Writes a single message straight to the socket, ahead of anything
+      # buffered. Used for the messages that set up a connection.
       def write_msg(sock, msg)
         t { "writing a #{msg.class} on the wire" }
         id = Messages::KLASS_TO_ID.fetch(msg.class)
@@ -254,6 +307,67 @@ module Skylight
         write(sock, frame) && write(sock, buf)
       end
 
+      def write_frames(sock, timeout = 5)
+        while @frames.native_write(sock.fileno) > 0
+          _, socks, = IO.select([], [sock], [], timeout)
+
+          unless socks == [sock]
+            t { "write timed out" }
+            return false
+          end
+        end
+
+        true
+      rescue SystemCallError => e
+        t { fmt "write failed; err=%s", e.class }
+        false
+      end
+
+      # Serializes the trace straight into the shared memory ring. Returns
+      # false if the ring is full, in which case the trace goes over the
+      # socket instead. Once the trace is in the ring it has been consumed,
+      # so true is returned however the wakeup goes; the agent drains the
+      # ring on its next wakeup regardless.
+      def push_ring(msg)
+        return false unless @ring.native_push_trace(msg)
+
+        msg.recycle
+
+        if @ring.native_wakeup?
+          handle(Messages::RingWakeup::INSTANCE)
+        end
+
+        true
+      end
+
+      # Sets up a shared memory ring for the new connection when the ring IPC
+      # mode is enabled. The agent removes the file once it has mapped it.
+      def attach_ring(sock, pid)
+        close_ring
+
+        return unless @ipc_ring
+
+        name = "skylight-#{pid}-#{Process.pid}-#{@rings += 1}.ring"
+        path = "#{sockfile_path}/#{name}"
+
+        ring = Skylight::Ring.native_create(path, config[:'agent.ipc_ring_size'])
+
+        if write_msg(sock, Messages::RingAttach.new(name))
+          t { fmt "attached IPC ring; path=%s; capacity=%d", path, ring.native_capacity }
+          @ring = ring
+        else
+          ring.native_close
+          File.unlink(path) rescue nil
+        end
+      rescue SystemCallError => e
+        debug "could not create IPC ring, using the socket; err=%s", e.message
+      end
+
+      def close_ring
+        @ring.native_close if @ring
+        @ring = nil
+      end
+
       SOCK_TIMEOUT_VAL = [ 0, 0.01 * 1_000_000 ].pack("l_2")
 
       # TODO: Handle configuring the socket with proper timeouts
@@ -321,8 +435,8 @@ module Skylight
 
           f.truncate(0)
 
-          # Lock acquired, cleanup old sock files
-          Dir["#{sockfile_path}/skylight-*.sock"].each do |sf|
+          # Lock acquired, cleanup old sock and ring files
+          Dir["#{sockfile_path}/skylight-*.{sock,ring}"].each do |sf|
             File.unlink(sf) rescue nil
           end
 
@@ -362,9 +476,13 @@ module Skylight
             # Update the current process ID
             @me = Process.pid
 
-            # Deal w/ the inherited socket
+            # Deal w/ the inherited socket and ring
             @sock.close rescue nil if @sock
             @sock = nil
+            close_ring
+
+            # Drop messages buffered by the parent
+            @frames = Skylight::FrameWriter.native_new
 
             @writer = build_queue
             @writer.spawn
@@ -398,7 +516,7 @@ module Skylight
       end
 
       def build_queue
-        Util::Task.new(100, 1) { |m| writer_tick(m) }
+        Util::Task.new(QUEUE_SIZE, 1, WRITE_BATCH) { |m| writer_tick(m) }
       end
 
       def read_lockfile
@@ -84,6 +84,28 @@ module SpecHelper
     Skylight.start! config
   end
 
+  # A native trace for the endpoint, left unnamed when name is nil. Its
+  # root span runs from 0 to :duration, and :spans lists the
+  # [category, title, started_at, ended_at] of the spans inside it.
+  def build_trace(name, opts = {})
+    trace = Skylight::Trace.native_new(0, "uuid")
+    trace.native_set_name(name) if name
+    root = trace.native_start_span(0, opts[:category] || "app.rack.request")
+
+    (opts[:spans] || []).each do |category, title, started_at, ended_at|
+      span = trace.native_start_span(started_at, category)
+      trace.native_span_set_title(span, title) if title
+      trace.native_stop_span(span, ended_at)
+    end
+
+    trace.native_stop_span(root, opts[:duration] || 10)
+    trace
+  end
+
+  def serialized_trace(name, opts = {})
+    build_trace(name, opts).native_serialize
+  end
+
   def annotation(key=nil, type=nil, value=nil, &block)
     Skylight::Messages::Annotation.new.tap do |annotation|
       annotation.key = key if key
@@ -0,0 +1,97 @@
+require 'socket'
+require 'thread'
+
+module SpecHelper
+  # A bare HTTP/1.1 server that keeps connections alive, for specs that
+  # need to see how requests map onto connections. It records every request
+  # it reads, raw body included, and answers each one with an empty JSON
+  # object unless told to drop it.
+  class KeepAliveServer
+    Request = Struct.new(:method, :path, :headers, :body)
+
+    attr_reader :port
+
+    def initialize
+      @server = TCPServer.new('127.0.0.1', 0)
+      @port = @server.addr[1]
+      @lock = Mutex.new
+      @connections = 0
+      @requests = []
+      @drop = 0
+      @threads = []
+      @thread = Thread.new { accept_loop }
+    end
+
+    def connections
+      @lock.synchronize { @connections }
+    end
+
+    def requests
+      @lock.synchronize { @requests.dup }
+    end
+
+    # Closes the connection after reading the next request, without
+    # answering it, as a server that timed the connection out would
+    def drop_next
+      @lock.synchronize { @drop += 1 }
+    end
+
+    def close
+      @thread.kill
+      @threads.each(&:kill)
+      @server.close
+    end
+
+  private
+
+    def accept_loop
+      loop do
+        sock = @server.accept
+        @lock.synchronize { @connections += 1 }
+        @threads << Thread.new(sock) { |s| serve(s) }
+      end
+    end
+
+    def serve(sock)
+      while req = read_request(sock)
+        drop = @lock.synchronize do
+          @requests << req
+          @drop > 0 && (@drop -= 1) >= 0
+        end
+
+        break if drop
+
+        sock.write "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: 2\r\n\r\n{}"
+      end
+    rescue IOError, SystemCallError
+    ensure
+      sock.close rescue nil
+    end
+
+    def read_request(sock)
+      return unless line = sock.gets
+
+      method, path, _ = line.split(' ')
+      headers = {}
+
+      while (line = sock.gets) && line != "\r\n"
+        key, val = line.split(': ', 2)
+        headers[key.downcase] = val.strip
+      end
+
+      body = ''.force_encoding(Encoding::BINARY)
+
+      if headers['transfer-encoding'] == 'chunked'
+        while (len = sock.gets.to_i(16)) > 0
+          body << sock.read(len)
+          sock.read(2)
+        end
+        sock.gets
+      elsif len = headers['content-length']
+        body << sock.read(len.to_i)
+      end
+
+      Request.new(method, path, headers, body)
+    end
+  end
+end
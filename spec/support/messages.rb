@@ -1,3 +1,3 @@
-%w[ annotation event span trace endpoint batch ].each do |message|
+%w[ annotation event span trace histogram rollup endpoint batch ].each do |message|
   require(File.expand_path("../messages/#{message}", __FILE__))
 end
@@ -3,9 +3,11 @@ module SpecHelper
     class Endpoint
       include Beefcake::Message
 
-      required :name,   :string, 1
-      required :count,  :uint64, 2
-      repeated :traces, Trace,   3
+      required :name,      :string,   1
+      required :count,     :uint64,   2
+      repeated :traces,    Trace,     3
+      optional :histogram, Histogram, 4
+      repeated :rollups,   Rollup,    5
 
     end
   end
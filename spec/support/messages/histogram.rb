@@ -0,0 +1,12 @@
+module SpecHelper
+  module Messages
+    class Histogram
+      include Beefcake::Message
+
+      required :precision, :uint32, 1
+      repeated :buckets,   :uint32, 2, packed: true
+      repeated :counts,    :uint64, 3, packed: true
+
+    end
+  end
+end
@@ -0,0 +1,15 @@
+module SpecHelper
+  module Messages
+    class Rollup
+      include Beefcake::Message
+
+      required :category,  :string,   1
+      optional :title,     :string,   2
+      required :count,     :uint64,   3
+      required :total,     :uint64,   4
+      required :max,       :uint64,   5
+      optional :histogram, Histogram, 6
+
+    end
+  end
+end
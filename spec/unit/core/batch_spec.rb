@@ -1,4 +1,6 @@
 require 'spec_helper'
+require 'zlib'
+require 'stringio'
 
 module Skylight
   describe 'Batch', :agent do
@@ -14,5 +16,112 @@ module Skylight
       endpoint.count.should == 3
       endpoint.traces.should be_nil
     end
+
+    it 'encodes serialized traces without a native batch' do
+      foo = serialized_trace("foo")
+      bar = serialized_trace("bar")
+
+      counter = EndpointCounter.native_new
+      [foo, bar, foo].each { |t| counter.native_push(t) }
+
+      actual = SpecHelper::Messages::Batch.decode(
+        Batch.native_encode(100, "localhost", counter, [foo, bar, foo]))
+
+      actual.timestamp.should == 100
+      actual.hostname.should == "localhost"
+      actual.endpoints.should have(2).items
+
+      endpoint = actual.endpoints.detect { |e| e.name == "foo" }
+      endpoint.count.should == 2
+      endpoint.traces.should have(2).items
+      endpoint.traces[0].endpoint.should == "foo"
+      endpoint.traces[0].spans[0].duration.should == 10
+    end
+
+    it 'encodes endpoint histograms' do
+      foo = serialized_trace("foo")
+
+      counter = EndpointCounter.native_new
+      3.times { counter.native_push(foo) }
+
+      actual = SpecHelper::Messages::Batch.decode(Batch.native_encode(0, nil, counter, []))
+
+      histogram = actual.endpoints[0].histogram
+      histogram.precision.should == 4
+      histogram.buckets.should == [10]
+      histogram.counts.should == [3]
+    end
+
+    it 'encodes span rollups' do
+      counter = EndpointCounter.native_new
+      counter.native_push(serialized_trace("foo", spans: [["db.sql.query", "SELECT FROM users", 1, 9]]))
+
+      actual = SpecHelper::Messages::Batch.decode(Batch.native_encode(0, nil, counter, []))
+
+      rollups = actual.endpoints[0].rollups
+      rollups.should have(2).items
+
+      rollups[0].category.should == "app.rack.request"
+      rollups[0].title.should be_nil
+      rollups[0].count.should == 1
+      rollups[0].total.should == 10
+
+      rollups[1].category.should == "db.sql.query"
+      rollups[1].title.should == "SELECT FROM users"
+      rollups[1].count.should == 1
+      rollups[1].total.should == 8
+      rollups[1].max.should == 8
+      rollups[1].histogram.precision.should == 0
+      rollups[1].histogram.buckets.should == [4]
+      rollups[1].histogram.counts.should == [1]
+    end
+
+    it 'encodes counts for endpoints without traces' do
+      counter = EndpointCounter.native_new
+      3.times { counter.native_push(serialized_trace("foo")) }
+
+      actual = SpecHelper::Messages::Batch.decode(Batch.native_encode(0, nil, counter, []))
+
+      actual.hostname.should be_nil
+      actual.endpoints[0].name.should == "foo"
+      actual.endpoints[0].count.should == 3
+      actual.endpoints[0].traces.should be_nil
+    end
+
+    it 'encodes the traces held by a reservoir' do
+      foo = serialized_trace("foo")
+
+      counter = EndpointCounter.native_new
+      reservoir = Reservoir.native_new(1, false)
+
+      2.times do
+        counter.native_push(foo)
+        reservoir.native_push(foo)
+      end
+
+      actual = SpecHelper::Messages::Batch.decode(Batch.native_encode(0, nil, counter, reservoir))
+
+      actual.endpoints[0].count.should == 2
+      actual.endpoints[0].traces.should have(1).item
+      actual.endpoints[0].traces[0].endpoint.should == "foo"
+    end
+
+    it 'gzips the batch when given a compression level' do
+      foo = serialized_trace("foo")
+
+      counter = EndpointCounter.native_new
+      counter.native_push(foo)
+
+      raw = Batch.native_encode(100, "localhost", counter, [foo])
+      gzipped = Batch.native_encode(100, "localhost", counter, [foo], 9)
+
+      Zlib::GzipReader.new(StringIO.new(gzipped)).read.force_encoding("BINARY").should == raw
+    end
+
+    it 'rejects invalid compression levels' do
+      lambda {
+        Batch.native_encode(0, nil, EndpointCounter.native_new, [], 10)
+      }.should raise_error(ArgumentError)
+    end
   end
 end
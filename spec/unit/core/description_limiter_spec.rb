@@ -0,0 +1,64 @@
+require 'spec_helper'
+
+module Skylight
+  describe 'DescriptionLimiter', :agent do
+    let :limiter do
+      DescriptionLimiter.native_new(3, 0, 16)
+    end
+
+    it 'allows up to max distinct descriptions per endpoint' do
+      limiter.native_add("foo", "a").should be_true
+      limiter.native_add("foo", "b").should be_true
+      limiter.native_add("foo", nil).should be_true
+      limiter.native_add("foo", "c").should be_false
+
+      limiter.native_count("foo").should == 3
+    end
+
+    it 'keeps allowing descriptions it has seen' do
+      3.times { |i| limiter.native_add("foo", "desc-#{i}") }
+
+      limiter.native_add("foo", "desc-1").should be_true
+      limiter.native_add("foo", "desc-3").should be_false
+    end
+
+    it 'limits endpoints separately' do
+      3.times { |i| limiter.native_add("foo", "desc-#{i}") }
+
+      limiter.native_add("bar", "desc-3").should be_true
+      limiter.native_count("bar").should == 1
+      limiter.native_count("baz").should == 0
+    end
+
+    it 'forgets descriptions once the window is over' do
+      limiter = DescriptionLimiter.native_new(1, 1, 16)
+
+      limiter.native_add("foo", "a").should be_true
+      limiter.native_add("foo", "b").should be_false
+
+      sleep 1.1
+
+      limiter.native_add("foo", "b").should be_true
+    end
+
+    it 'shares one limit between the endpoints past its capacity' do
+      limiter = DescriptionLimiter.native_new(3, 0, 1)
+
+      3.times { |i| limiter.native_add("foo", "desc-#{i}").should be_true }
+
+      limiter.native_add("bar", "a").should be_true
+      limiter.native_add("baz", "b").should be_true
+      limiter.native_add("bar", "c").should be_true
+      limiter.native_add("baz", "d").should be_false
+
+      limiter.native_count("foo").should == 3
+      limiter.native_count("bar").should == 3
+      limiter.native_count("baz").should == 3
+    end
+
+    it 'rejects bad endpoint counts' do
+      lambda { DescriptionLimiter.native_new(3, 0, 0) }.should raise_error(ArgumentError)
+      lambda { DescriptionLimiter.native_new(3, 0, 100_000) }.should raise_error(ArgumentError)
+    end
+  end
+end
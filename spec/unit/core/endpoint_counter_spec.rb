@@ -0,0 +1,83 @@
+require 'spec_helper'
+
+module Skylight
+  describe 'EndpointCounter', :agent do
+    let :counter do
+      EndpointCounter.native_new
+    end
+
+    it 'counts serialized traces by endpoint name' do
+      foo = serialized_trace("foo")
+
+      counter.native_push(foo).should be_true
+      counter.native_push(foo).should be_true
+      counter.native_push(serialized_trace("bar")).should be_true
+
+      counter.native_length.should == 2
+      counter.native_count("foo").should == 2
+      counter.native_count("bar").should == 1
+      counter.native_count("baz").should == 0
+      counter.native_counts.should == { "foo" => 2, "bar" => 1 }
+    end
+
+    it 'does not count traces without an endpoint name' do
+      counter.native_push(serialized_trace(nil)).should be_false
+      counter.native_length.should == 0
+    end
+
+    it 'records root span durations in log-linear buckets' do
+      [3, 3, 16, 31, 1000, 1023, 1024].each do |duration|
+        counter.native_push(serialized_trace("foo", duration: duration))
+      end
+
+      counter.native_histogram("foo").should == { 3 => 2, 16 => 1, 31 => 1, 992 => 2, 1024 => 1 }
+      counter.native_histogram("bar").should == {}
+    end
+
+    def trace_with_queries(name, titles)
+      spans = titles.each_with_index.map { |title, i| ["db.sql.query", title, i * 10, i * 10 + 4] }
+      serialized_trace(name, duration: 100, spans: spans)
+    end
+
+    it 'rolls up spans by category and title' do
+      counter.native_push(trace_with_queries("foo", ["SELECT FROM users", "SELECT FROM posts", "SELECT FROM users"]))
+      counter.native_push(trace_with_queries("foo", ["SELECT FROM users"]))
+
+      counter.native_rollups("foo").should == {
+        ["app.rack.request", nil]             => [2, 200, 100],
+        ["db.sql.query", "SELECT FROM users"] => [3, 12, 4],
+        ["db.sql.query", "SELECT FROM posts"] => [1, 4, 4] }
+
+      counter.native_rollups("bar").should == {}
+    end
+
+    it 'rolls up spans past the title limit under their category' do
+      300.times { |i| counter.native_push(trace_with_queries("foo", ["query #{i}"])) }
+
+      rollups = counter.native_rollups("foo")
+      rollups.should have(257).items
+      rollups[["db.sql.query", nil]].should == [45, 180, 4]
+    end
+
+    it 'rolls up new untitled categories past the title limit' do
+      257.times do |i|
+        counter.native_push(serialized_trace("foo", category: "category.#{i}")).should be_true
+      end
+
+      rollups = counter.native_rollups("foo")
+      rollups.should have(257).items
+      rollups[["category.256", nil]].should == [1, 10, 10]
+    end
+
+    it 'grows past its initial capacity' do
+      100.times { |i| counter.native_push(serialized_trace("endpoint-#{i}")) }
+
+      counter.native_length.should == 100
+      counter.native_count("endpoint-42").should == 1
+    end
+
+    it 'only accepts strings' do
+      lambda { counter.native_push(nil) }.should raise_error(ArgumentError)
+    end
+  end
+end
@@ -0,0 +1,77 @@
+require 'spec_helper'
+require 'socket'
+
+module Skylight
+  describe 'FrameReader', :agent do
+    let :socks do
+      UNIXSocket.pair
+    end
+
+    let :reader do
+      FrameReader.native_new
+    end
+
+    after :each do
+      socks.each { |s| s.close rescue nil }
+    end
+
+    def frame(id, payload)
+      [id, payload.bytesize].pack("LL") + payload
+    end
+
+    def read(frames = [])
+      reader.native_read(socks[1].fileno, frames)
+      frames
+    end
+
+    it 'returns nothing when no data is available' do
+      read.should == []
+    end
+
+    it 'returns every complete frame' do
+      socks[0].write(frame(0, "foo") + frame(2, "") + frame(1, "bar"))
+      read.should == [0, "foo", 2, "", 1, "bar"]
+    end
+
+    it 'returns frozen payloads' do
+      socks[0].write(frame(0, "foo"))
+      read[1].should be_frozen
+    end
+
+    it 'keeps partial frames until they are complete' do
+      data = frame(0, "foo") + frame(1, "hello world")
+
+      socks[0].write(data[0, 15])
+      read.should == [0, "foo"]
+      reader.native_pending.should == 4
+
+      socks[0].write(data[15..-1])
+      read.should == [1, "hello world"]
+      reader.native_pending.should == 0
+    end
+
+    it 'grows to fit large frames' do
+      payload = "x" * 200_000
+      writer = Thread.new { socks[0].write(frame(0, payload)) }
+      frames = []
+
+      while frames.empty?
+        IO.select([socks[1]])
+        read(frames)
+      end
+
+      writer.join
+      frames.should == [0, payload]
+    end
+
+    it 'rejects oversized frames' do
+      socks[0].write([0, 0x7fffffff].pack("LL"))
+      lambda { read }.should raise_error(IpcProtoError)
+    end
+
+    it 'raises EOFError once the socket is closed' do
+      socks[0].close
+      lambda { read }.should raise_error(EOFError)
+    end
+  end
+end
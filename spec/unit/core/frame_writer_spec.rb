@@ -0,0 +1,61 @@
+require 'spec_helper'
+require 'socket'
+
+module Skylight
+  describe 'FrameWriter', :agent do
+    let :socks do
+      UNIXSocket.pair
+    end
+
+    let :writer do
+      FrameWriter.native_new
+    end
+
+    after :each do
+      socks.each { |s| s.close rescue nil }
+    end
+
+    def frame(id, payload)
+      [id, payload.bytesize].pack("LL") + payload
+    end
+
+    it 'writes buffered frames at once' do
+      writer.native_push(2, "foo")
+      writer.native_push(1, "")
+      writer.native_length.should == 19
+
+      writer.native_write(socks[0].fileno).should == 0
+      writer.native_length.should == 0
+
+      socks[1].read_nonblock(100).should == frame(2, "foo") + frame(1, "")
+    end
+
+    it 'serializes traces into the buffer' do
+      trace = build_trace("foo")
+      expected = build_trace("foo").native_serialize
+
+      writer.native_push_trace(trace)
+      writer.native_write(socks[0].fileno)
+
+      socks[1].read_nonblock(100).should == frame(0, expected)
+      lambda { trace.native_serialize }.should raise_error(RuntimeError)
+    end
+
+    it 'keeps what the socket did not take' do
+      writer.native_push(0, "x" * 1_000_000)
+
+      remaining = writer.native_write(socks[0].fileno)
+      remaining.should > 0
+      writer.native_length.should == remaining
+    end
+
+    it 'drops a partially written frame on restart' do
+      writer.native_push(0, "x" * 1_000_000)
+      writer.native_push(0, "tail")
+      writer.native_write(socks[0].fileno)
+
+      writer.native_restart.should == 1
+      writer.native_length.should == frame(0, "tail").bytesize
+    end
+  end
+end
@@ -0,0 +1,45 @@
+require 'spec_helper'
+
+module Skylight
+  describe 'GcTracker', :agent do
+    before :each do
+      pending "GC events are not available on this VM" unless GcTracker.native_supported?
+      GcTracker.native_enable
+    end
+
+    it 'counts the time spent in GC' do
+      time = GcTracker.native_total_time
+      runs = GcTracker.native_runs
+
+      3.times { ::GC.start }
+
+      GcTracker.native_total_time.should > time
+      GcTracker.native_runs.should >= runs + 3
+    end
+
+    it 'only counts while enabled' do
+      GcTracker.native_disable
+      time = GcTracker.native_total_time
+
+      ::GC.start
+
+      GcTracker.native_total_time.should == time
+    end
+
+    it 'is what the default profiler reads' do
+      VM::GC.new.should be_monotonic
+    end
+
+    it 'is snapshot by each trace without listeners' do
+      gc = Skylight::GC.new(nil, VM::GC.new)
+      win = gc.track
+
+      win.should be_a(Skylight::GC::Snapshot)
+      gc.instance_variable_get(:@listeners).should be_empty
+
+      ::GC.start
+      win.update
+      win.time.should > 0
+    end
+  end
+end
@@ -0,0 +1,108 @@
+require 'spec_helper'
+
+module Skylight
+  describe 'IngestShards', :agent do
+    def query_trace(name, duration = 10)
+      serialized_trace(name, duration: duration, spans: [["db.sql.query", "SELECT FROM #{name}", 1, duration - 1]])
+    end
+
+    def drain(shards, size = 100, weighted = false)
+      counter = EndpointCounter.native_new
+      sample  = Reservoir.native_new(size, weighted)
+      shards.native_drain(counter, sample)
+      [counter, sample]
+    end
+
+    it 'counts like a single endpoint counter' do
+      shards = IngestShards.native_new(4, 100, false)
+      expected = EndpointCounter.native_new
+
+      1000.times do |i|
+        trace = query_trace("endpoint-#{i % 30}", i % 100 + 1)
+        shards.native_push(trace).should be_true
+        expected.native_push(trace)
+      end
+
+      shards.native_count.should == 1000
+
+      counter, sample = drain(shards)
+
+      counter.native_counts.should == expected.native_counts
+
+      expected.native_counts.each_key do |name|
+        counter.native_histogram(name).should == expected.native_histogram(name)
+        counter.native_rollups(name).should == expected.native_rollups(name)
+      end
+
+      sample.native_count.should == 1000
+      sample.native_length.should == 100
+      shards.native_count.should == 0
+    end
+
+    it 'skips traces without an endpoint name' do
+      shards = IngestShards.native_new(2, 10, false)
+
+      shards.native_push(query_trace(nil)).should be_false
+      shards.native_count.should == 0
+    end
+
+    it 'adds to what was drained before' do
+      shards = IngestShards.native_new(2, 10, false)
+      counter = EndpointCounter.native_new
+      sample  = Reservoir.native_new(10, false)
+
+      3.times do
+        5.times { shards.native_push(query_trace("foo")) }
+        shards.native_drain(counter, sample).should == 5
+      end
+
+      counter.native_count("foo").should == 15
+      sample.native_count.should == 15
+      sample.native_length.should == 10
+    end
+
+    it 'samples uniformly across shards' do
+      srand(1)
+
+      traces = 20.times.map { |i| query_trace("endpoint-#{i}") }
+      hits = Hash.new(0)
+      shards = IngestShards.native_new(4, 5, false)
+
+      1000.times do
+        traces.each { |t| shards.native_push(t) }
+        drain(shards, 5).last.native_traces.each { |t| hits[t] += 1 }
+      end
+
+      traces.each { |t| hits[t].should be_within(70).of(250) }
+    end
+
+    it 'prefers slow traces when weighted' do
+      shards = IngestShards.native_new(4, 10, true)
+
+      100.times { |i| shards.native_push(query_trace("fast-#{i % 4}", 10)) }
+      10.times { shards.native_push(query_trace("slow", 100_000)) }
+
+      names = drain(shards, 10, true).last.native_traces.map { |t| Trace.native_name_from_serialized(t) }
+      names.count("slow").should >= 8
+    end
+
+    it 'takes in every trace past the rollup limit' do
+      shards = IngestShards.native_new(2, 10, false)
+
+      257.times do |i|
+        shards.native_push(serialized_trace("foo", category: "category.#{i}"))
+      end
+
+      counter, sample = drain(shards)
+
+      shards.native_failures.should == 0
+      counter.native_count("foo").should == 257
+      counter.native_rollups("foo").should have(257).items
+    end
+
+    it 'rejects bad shard counts' do
+      lambda { IngestShards.native_new(0, 10, false) }.should raise_error(ArgumentError)
+      lambda { IngestShards.native_new(1000, 10, false) }.should raise_error(ArgumentError)
+    end
+  end
+end
@@ -0,0 +1,66 @@
+require 'spec_helper'
+
+module Skylight
+  describe 'LruCache', :agent do
+    let :cache do
+      LruCache.native_new(3)
+    end
+
+    it 'returns cached values' do
+      cache["foo"] = 1
+      cache["bar"] = 2
+
+      cache["foo"].should == 1
+      cache["bar"].should == 2
+      cache["baz"].should be_nil
+
+      cache.length.should == 2
+      cache.hits.should == 2
+      cache.misses.should == 1
+    end
+
+    it 'evicts the least recently used entry' do
+      cache["a"] = 1
+      cache["b"] = 2
+      cache["c"] = 3
+
+      cache["a"]
+      cache["d"] = 4
+
+      cache["b"].should be_nil
+      cache["a"].should == 1
+      cache["c"].should == 3
+      cache["d"].should == 4
+      cache.length.should == 3
+    end
+
+    it 'replaces the value of an existing key' do
+      cache["a"] = 1
+      cache["a"] = 2
+
+      cache["a"].should == 2
+      cache.length.should == 1
+    end
+
+    it 'is not affected by changes to a key once stored' do
+      key = "foo"
+      cache[key] = 1
+      key << "bar"
+
+      cache["foo"].should == 1
+      cache["foobar"].should be_nil
+    end
+
+    it 'clears' do
+      cache["a"] = 1
+      cache.clear
+
+      cache.length.should == 0
+      cache["a"].should be_nil
+    end
+
+    it 'only accepts string keys' do
+      lambda { cache[:foo] = 1 }.should raise_error(ArgumentError)
+    end
+  end
+end
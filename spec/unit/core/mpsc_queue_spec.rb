@@ -0,0 +1,76 @@
+require 'spec_helper'
+
+module Skylight
+  describe 'MpscQueue', :agent do
+    let :queue do
+      MpscQueue.native_new(3)
+    end
+
+    it 'pushes until full and counts drops' do
+      queue.push(1).should == 1
+      queue.push(2).should == 2
+      queue.push(3).should == 3
+      queue.push(4).should be_nil
+
+      queue.length.should == 3
+      queue.drops.should == 1
+      queue.high_water.should == 3
+    end
+
+    it 'pops in order' do
+      3.times { |i| queue.push(i) }
+
+      queue.pop(0).should == 0
+      queue.drain(5).should == [1, 2]
+      queue.pop(0).should be_nil
+      queue.should be_empty
+      queue.high_water.should == 3
+    end
+
+    it 'times out when empty' do
+      queue.pop(0.05).should be_nil
+    end
+
+    it 'wakes up a blocked consumer' do
+      t = Thread.new { queue.pop(5) }
+      sleep 0.05 until t.status == "sleep"
+
+      queue.push(:foo)
+      t.value.should == :foo
+    end
+
+    it 'can be killed while blocked' do
+      t = Thread.new { queue.pop }
+      sleep 0.05 until t.status == "sleep"
+
+      t.kill
+      t.join(1).should == t
+    end
+
+    it 'does not lose items pushed from many threads' do
+      queue = MpscQueue.native_new(100)
+      popped = []
+
+      consumer = Thread.new do
+        while (msg = queue.pop(1)) != :done
+          popped << msg
+        end
+      end
+
+      producers = 4.times.map do |i|
+        Thread.new do
+          1000.times do |j|
+            Thread.pass until queue.push([i, j])
+          end
+        end
+      end
+
+      producers.each(&:join)
+      Thread.pass until queue.push(:done)
+      consumer.join
+
+      popped.length.should == 4000
+      popped.uniq.length.should == 4000
+    end
+  end
+end
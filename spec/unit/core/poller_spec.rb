@@ -0,0 +1,64 @@
+require 'spec_helper'
+require 'socket'
+
+module Skylight
+  describe 'Poller', :agent do
+    before :each do
+      pending "epoll is not available" unless defined?(Skylight::Poller)
+    end
+
+    let :poller do
+      Poller.native_new
+    end
+
+    let :pair do
+      UNIXSocket.pair
+    end
+
+    after :each do
+      poller.native_close if defined?(Skylight::Poller)
+      pair.each(&:close) rescue nil
+    end
+
+    it 'reports readable fds' do
+      a, b = pair
+      poller.native_add(b.fileno, false)
+      poller.native_timer(5_000)
+
+      a.write("x")
+
+      ready = []
+      poller.native_wait(ready).should == 0
+      ready.should == [b.fileno]
+    end
+
+    it 'reports timer expirations' do
+      poller.native_timer(10)
+
+      ready = []
+      poller.native_wait(ready).should >= 1
+      ready.should be_empty
+    end
+
+    it 'stops reporting removed fds' do
+      a, b = pair
+      poller.native_add(b.fileno, false)
+      poller.native_remove(b.fileno)
+      poller.native_timer(10)
+
+      a.write("x")
+
+      ready = []
+      poller.native_wait(ready)
+      ready.should be_empty
+    end
+
+    it 'lets other threads run while waiting' do
+      poller.native_timer(200)
+      thread = Thread.new { :ran }
+
+      poller.native_wait([])
+      thread.value.should == :ran
+    end
+  end
+end
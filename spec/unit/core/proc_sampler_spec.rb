@@ -0,0 +1,43 @@
+require 'spec_helper'
+
+module Skylight
+  describe 'ProcSampler', :agent do
+    let :sampler do
+      ProcSampler.native_new
+    end
+
+    before :each do
+      pending "/proc is not available" unless File.exist?("/proc/self/statm")
+    end
+
+    it 'reads the process usage' do
+      sampler.sample.should be_true
+
+      sampler.rss.should > 0
+      sampler.minor_faults.should > 0
+      sampler.threads.should >= 1
+      sampler.cpu_total.should >= sampler.cpu_usage
+      sampler.open_fds.should >= 3
+    end
+
+    it 'counts open file descriptors' do
+      sampler.sample
+      fds = sampler.open_fds
+
+      File.open(__FILE__) do
+        sampler.sample
+        sampler.open_fds.should == fds + 1
+      end
+    end
+
+    it 'backs the memory gauge' do
+      gauge = Metrics::ProcessMemGauge.new(30, Util::Clock.default, sampler)
+      gauge.call.should == sampler.rss / (1024 * 1024)
+    end
+
+    it 'backs the health gauges' do
+      gauge = Metrics::ProcessHealthGauge.new(sampler, :threads)
+      gauge.call.should >= Thread.list.length
+    end
+  end
+end
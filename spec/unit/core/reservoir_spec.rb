@@ -0,0 +1,74 @@
+require 'spec_helper'
+
+module Skylight
+  describe 'Reservoir', :agent do
+    it 'keeps every trace until it is full' do
+      reservoir = Reservoir.native_new(3, false)
+      traces = %w(foo bar baz).map { |n| serialized_trace(n) }
+
+      traces.each { |t| reservoir.native_push(t).should be_true }
+
+      reservoir.native_count.should == 3
+      reservoir.native_length.should == 3
+      reservoir.native_traces.should == traces
+      reservoir.native_bytesize.should == traces.map(&:bytesize).inject(:+)
+    end
+
+    it 'keeps a bounded sample once full' do
+      reservoir = Reservoir.native_new(5, false)
+      trace = serialized_trace("foo" * 100)
+
+      10_000.times { reservoir.native_push(trace) }
+
+      reservoir.native_count.should == 10_000
+      reservoir.native_length.should == 5
+      reservoir.native_bytesize.should == trace.bytesize * 5
+    end
+
+    it 'samples uniformly' do
+      srand(1)
+
+      traces = 20.times.map { |i| serialized_trace("endpoint-#{i}") }
+      hits = Hash.new(0)
+
+      1000.times do
+        reservoir = Reservoir.native_new(5, false)
+        traces.each { |t| reservoir.native_push(t) }
+        reservoir.native_traces.each { |t| hits[t] += 1 }
+      end
+
+      traces.each { |t| hits[t].should be_within(70).of(250) }
+    end
+
+    it 'prefers slow traces when weighted' do
+      srand(1)
+
+      slow = serialized_trace("slow", duration: 1000)
+      fast = serialized_trace("fast", duration: 10)
+      kept = Hash.new(0)
+
+      100.times do
+        reservoir = Reservoir.native_new(10, true)
+        100.times { reservoir.native_push(fast) }
+        10.times { reservoir.native_push(slow) }
+        reservoir.native_traces.each { |t| kept[t] += 1 }
+      end
+
+      kept[slow].should > kept[fast]
+    end
+
+    it 'can be cleared' do
+      reservoir = Reservoir.native_new(2, false)
+      reservoir.native_push(serialized_trace("foo"))
+      reservoir.native_clear
+
+      reservoir.native_count.should == 0
+      reservoir.native_length.should == 0
+      reservoir.native_traces.should == []
+    end
+
+    it 'rejects negative sizes' do
+      lambda { Reservoir.native_new(-1, false) }.should raise_error(ArgumentError)
+    end
+  end
+end
@@ -0,0 +1,143 @@
+require 'spec_helper'
+
+module Skylight
+  describe 'Ring', :agent do
+    let :path do
+      tmp("skylight-spec.ring").tap { |p| p.dirname.mkdir_p }.to_s
+    end
+
+    let :producer do
+      Ring.native_create(path, 64 * 1024)
+    end
+
+    let :consumer do
+      producer
+      Ring.native_open(path)
+    end
+
+    after :each do
+      File.unlink(path) rescue nil
+    end
+
+    it 'passes serialized traces from the producer to the consumer' do
+      consumer.native_shift.should be_nil
+
+      producer.native_push_trace(build_trace("foo")).should be_true
+      producer.native_push(serialized_trace("bar")).should be_true
+
+      consumer.native_shift.should == serialized_trace("foo")
+      consumer.native_shift.should == serialized_trace("bar")
+      consumer.native_shift.should be_nil
+    end
+
+    it 'consumes the trace it serializes' do
+      trace = build_trace("foo")
+      producer.native_push_trace(trace)
+
+      lambda { trace.native_serialize }.should raise_error(RuntimeError)
+    end
+
+    it 'asks for a wakeup only when the consumer is waiting' do
+      consumer.native_shift.should be_nil
+
+      producer.native_push(serialized_trace("foo"))
+      producer.native_wakeup?.should be_true
+
+      producer.native_push(serialized_trace("foo"))
+      producer.native_wakeup?.should be_false
+    end
+
+    it 'wraps around' do
+      trace = serialized_trace("foo" * 100)
+
+      1000.times do
+        producer.native_push(trace).should be_true
+        consumer.native_shift.should == trace
+      end
+
+      producer.native_used.should == 0
+    end
+
+    it 'rejects messages once full' do
+      trace = serialized_trace("foo" * 1000)
+      pushed = 0
+
+      pushed += 1 while producer.native_push(trace)
+
+      pushed.should > 0
+      producer.native_used.should <= producer.native_capacity
+
+      pushed.times { consumer.native_shift.should == trace }
+      consumer.native_shift.should be_nil
+    end
+
+    it 'does not open other files' do
+      File.open(path, 'w') { |f| f.write "not a ring" * 1000 }
+      lambda { Ring.native_open(path) }.should raise_error(ArgumentError)
+    end
+
+    it 'rejects records that run past the end of the ring' do
+      consumer
+      capacity = producer.native_capacity
+
+      # write_pos and read_pos sit at 64 and 128 in the header, which is
+      # followed by the data. A 32 byte record claimed 16 bytes from the end.
+      File.open(path, 'r+b') do |f|
+        f.seek(192 + capacity - 16)
+        f.write([32].pack("Q"))
+        f.seek(64)
+        f.write([capacity].pack("Q"))
+        f.seek(128)
+        f.write([capacity - 16].pack("Q"))
+      end
+
+      lambda { consumer.native_shift }.should raise_error(RuntimeError)
+    end
+
+    def write_header(write_pos, read_pos)
+      File.open(path, 'r+b') do |f|
+        f.seek(64)
+        f.write([write_pos].pack("Q"))
+        f.seek(128)
+        f.write([read_pos].pack("Q"))
+      end
+    end
+
+    it 'rejects a write position behind the read position' do
+      consumer
+      write_header(16, 32)
+
+      lambda { consumer.native_shift }.should raise_error(RuntimeError)
+    end
+
+    it 'rejects a write position more than the ring ahead' do
+      consumer
+      capacity = producer.native_capacity
+      write_header(capacity + 64, 0)
+
+      lambda { consumer.native_shift }.should raise_error(RuntimeError)
+    end
+
+    it 'rejects a skip that is not followed by a record' do
+      consumer
+      capacity = producer.native_capacity
+
+      # Skip markers at the start of the ring and 16 bytes before its end
+      File.open(path, 'r+b') do |f|
+        f.seek(192)
+        f.write([2 ** 64 - 1].pack("Q"))
+        f.seek(192 + capacity - 16)
+        f.write([2 ** 64 - 1].pack("Q"))
+      end
+
+      write_header(capacity + 32, capacity - 16)
+
+      lambda { consumer.native_shift }.should raise_error(RuntimeError)
+    end
+
+    it 'cannot be used once closed' do
+      producer.native_close
+      lambda { producer.native_push("foo") }.should raise_error(RuntimeError)
+    end
+  end
+end
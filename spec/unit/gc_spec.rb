@@ -94,4 +94,29 @@ module Skylight
     end
 
   end
+
+  describe VM::GC, :agent do
+
+    before :each do
+      pending "GC time is not tracked on this VM" if defined?(JRUBY_VERSION)
+    end
+
+    it 'reports its total time in nanoseconds' do
+      gc = VM::GC.new
+      gc.enable
+
+      time = gc.total_time
+      started_at = Time.now
+
+      10.times { ::GC.start }
+
+      elapsed = (Time.now - started_at) * 1_000_000_000
+      spent   = gc.total_time - time
+
+      # In microseconds it would be a thousandth of the time GC.start took
+      spent.should <= elapsed
+      spent.should > elapsed / 100
+    end
+
+  end
 end
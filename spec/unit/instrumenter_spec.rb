@@ -246,6 +246,38 @@ describe "Skylight::Instrumenter", :http, :agent do
       end
     end
 
+    context "with deferred normalization" do
+      before :each do
+        config[:'normalizers.defer'] = true
+        start!
+        clock.freeze
+      end
+
+      after :each do
+        Skylight.stop!
+      end
+
+      it 'normalizes notifications in the worker' do
+        Skylight.trace 'Testin', 'app.rack' do |t|
+          ActiveSupport::Notifications.instrument('sql.active_record', name: "Load User", sql: "SELECT * FROM posts WHERE id = 1", binds: []) do
+            clock.skip 1
+          end
+        end
+
+        clock.unfreeze
+        server.wait(count: 3)
+
+        t = server.reports[0].endpoints[0].traces[0]
+        t.should have(2).spans
+
+        t.spans[1].should == span(
+          parent:     0,
+          event:      event('db.sql.query', 'SELECT FROM posts', 'SELECT * FROM posts WHERE id = ?'),
+          started_at: 0,
+          duration:   10_000 )
+      end
+    end
+
     def with_endpoint(endpoint)
       config[:trace_info].current = Struct.new(:endpoint).new(endpoint)
       yield
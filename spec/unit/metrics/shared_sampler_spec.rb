@@ -0,0 +1,67 @@
+require 'spec_helper'
+
+module Skylight
+  module Metrics
+    describe SharedSampler do
+
+      class CountingSampler
+        attr_reader :samples
+
+        def initialize
+          @samples = 0
+        end
+
+        def sample
+          @samples += 1
+          true
+        end
+
+        def threads
+          @samples
+        end
+
+        def rss
+          1024 * 1024 * @samples
+        end
+      end
+
+      before :each do
+        clock.freeze
+      end
+
+      let :sampler do
+        CountingSampler.new
+      end
+
+      let :shared do
+        SharedSampler.new(sampler, 1, clock)
+      end
+
+      it 'samples once for every gauge read together' do
+        gauges = [
+          ProcessMemGauge.new(30, clock, shared),
+          ProcessHealthGauge.new(shared, :threads, 30, clock),
+          ProcessHealthGauge.new(shared, :rss, 30, clock)]
+
+        gauges.map(&:call).should == [1, 1, 1024 * 1024]
+        sampler.samples.should == 1
+
+        clock.skip 30
+
+        gauges.map(&:call).should == [2, 2, 2 * 1024 * 1024]
+        sampler.samples.should == 2
+      end
+
+      it 'samples again once the sample is old' do
+        shared.sample.should be_true
+        shared.sample.should be_true
+        sampler.samples.should == 1
+
+        clock.skip 1
+
+        shared.sample.should be_true
+        sampler.samples.should == 2
+      end
+    end
+  end
+end
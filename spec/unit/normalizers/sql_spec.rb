@@ -114,6 +114,41 @@ module Skylight
       }
     end
 
+    it "reuses lexed queries with different binds" do
+      sql = "select * from foo where id = $1 and kind = 'bar'"
+
+      2.times do |i|
+        name, title, desc, annotations =
+          normalize(name: "Foo Load", sql: sql, binds: [[Object.new, i]])
+
+        title.should == "SELECT FROM foo"
+        desc.should == "select * from foo where id = $1 and kind = ?"
+
+        annotations.should == {
+          sql: "select * from foo where id = $1 and kind = ?",
+          binds: [i.inspect, "'bar'"]
+        }
+      end
+    end
+
+    it "captures copies of the sql and binds" do
+      sql   = "select * from foo where name = $1"
+      value = "hello"
+
+      cat, payload = normalizers.capture(trace, "sql.active_record",
+        name: "Foo Load", sql: sql, binds: [[Object.new, value]])
+
+      sql.replace "select * from bar"
+      value.replace "goodbye"
+
+      cat.should == "db.sql.query"
+
+      name, title, desc, annotations = normalize(payload)
+
+      title.should == "SELECT FROM foo"
+      annotations[:binds].should == ["\"hello\""]
+    end
+
     it "Produces an error if the SQL isn't parsable" do
       name, title, desc, annotations =
         normalize(name: "Foo Load", sql: "NOT &REAL& ;;;SQL;;;", binds: [])
@@ -129,5 +164,17 @@ module Skylight
       error[2][:precalculated].should_not be_nil
       error[2][:backtrace].should_not be_nil
     end
+
+    it "Reports each run of an unparsable query with its own binds" do
+      2.times do |i|
+        name, title, desc, annotations =
+          normalize(name: "Foo Load", sql: "NOT &REAL& ;;;SQL;;;", binds: [[Object.new, i]])
+
+        error = annotations[:skylight_error]
+        error[0].should == "sql_parse"
+        error[2][:payload][:binds][0][1].should == i
+        error[2][:precalculated].should == [i.inspect]
+      end
+    end
   end
 end
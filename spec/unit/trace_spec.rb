@@ -167,6 +167,143 @@ module Skylight
       spans[2].event.title.should       == 'BAR'
       spans[2].event.description.should == Skylight::Instrumenter::TOO_MANY_UNIQUES
     end
+
+    it 'keeps recorded spans in order with instrumented spans' do
+      a = trace.instrument 'foo'
+      clock.skip 0.001
+      trace.record 'bar'
+      b = trace.instrument 'baz'
+      clock.skip 0.001
+      trace.done(b)
+      trace.done(a)
+      trace.traced
+
+      spans.should have(4).items
+      spans.map { |s| s.event.category }.should == %w(app.rack.request foo bar baz)
+
+      spans[2].parent.should     == 1
+      spans[2].started_at.should == 10
+      spans[3].parent.should     == 1
+      spans[3].duration.should   == 10
+    end
+
+    it 'flushes recorded spans when the buffer fills up' do
+      n = Messages::Trace::Builder::MAX_PENDING_SPANS + 1
+      n.times { |i| trace.record 'foo', "title #{i}" }
+      trace.traced
+
+      spans.should have(n + 1).items
+      spans.last.event.title.should == "title #{n - 1}"
+    end
+
+    it 'records many spans in one native call' do
+      native = Skylight::Trace.native_new(0, "uuid")
+      root = native.native_record_spans([0, nil, 'app.rack.request', nil, nil])
+      native.native_record_spans([
+        1, 3, 'foo', 'FOO', nil,
+        2, 2, 'bar', nil, 'How a bar is formed?' ]).should == 2
+      native.native_stop_span(root, 5)
+
+      spans = SpecHelper::Messages::Trace.decode(native.native_serialize).spans
+
+      spans.should have(3).items
+      spans[1].event.title.should       == 'FOO'
+      spans[1].duration.should          == 2
+      spans[2].event.description.should == 'How a bar is formed?'
+      spans[2].parent.should            == 0
+    end
+
+    it 'cannot be serialized or renamed once submitted' do
+      trace.submit
+
+      lambda { trace.serialize }.should raise_error(RuntimeError, /before submitting/)
+      lambda { trace.endpoint = 'Other' }.should raise_error(RuntimeError, /before submitting/)
+    end
+
+    it 'rejects span records that are not in groups of 5' do
+      native = Skylight::Trace.native_new(0, "uuid")
+      lambda { native.native_record_spans([0, nil, 'foo']) }.should raise_error(ArgumentError)
+    end
+
+    it 'interns strings once per process' do
+      id = Skylight::Trace.native_intern('db.sql.query')
+      Skylight::Trace.native_intern('db.sql.query').should == id
+      Skylight::Trace.intern('db.sql.query').should == id
+    end
+
+    it 'accepts interned categories and titles' do
+      native = Skylight::Trace.native_new(0, "uuid")
+      sp = native.native_start_span_interned(0, Skylight::Trace.intern('db.sql.query'))
+      native.native_span_set_title_interned(sp, Skylight::Trace.intern('SELECT FROM users'))
+      native.native_record_spans([1, 1, Skylight::Trace.intern('foo'), 'bar', nil])
+      native.native_stop_span(sp, 2)
+
+      spans = SpecHelper::Messages::Trace.decode(native.native_serialize).spans
+
+      spans[0].event.category.should == 'db.sql.query'
+      spans[0].event.title.should    == 'SELECT FROM users'
+      spans[1].event.category.should == 'foo'
+      spans[1].event.title.should    == 'bar'
+    end
+
+    it 'interns categories but not titles' do
+      a = trace.instrument 'interned.category', 'title that is not interned'
+      trace.done(a)
+
+      Skylight::Trace::INTERNED.should have_key('interned.category')
+      Skylight::Trace::INTERNED.should_not have_key('title that is not interned')
+    end
+
+    it 'rejects unknown interned ids' do
+      native = Skylight::Trace.native_new(0, "uuid")
+      lambda { native.native_start_span_interned(0, 1 << 20) }.should raise_error(ArgumentError)
+    end
+
+    it 'reads span times natively with the default clock' do
+      Util::Clock.default = Util::Clock.new
+      Util::Clock.native?.should be_true
+
+      native = Skylight::Trace.native_new(Util::Clock.new.native_ticks, "uuid")
+      sp = native.native_start_span_now(0, 'app.rack.request', nil, nil)
+      native.native_record_spans([native.native_now(0), native.native_now(0), 'foo', nil, nil])
+      sleep 0.002
+      native.native_stop_span_now(sp, 0)
+
+      spans = SpecHelper::Messages::Trace.decode(native.native_serialize).spans
+
+      spans.should have(2).items
+      spans[0].started_at.should <= 1
+      spans[0].duration.should   >= 20
+      spans[1].parent.should     == 0
+    end
+
+    it 'reuses recycled traces for new requests' do
+      Skylight::Trace::POOL.clear
+
+      native = Skylight::Trace.acquire(0, "uuid")
+      native.native_serialize
+      native.recycle
+
+      reused = Skylight::Trace.acquire(10, "uuid")
+      reused.should equal(native)
+      reused.native_get_started_at.should == 10
+
+      sp = reused.native_start_span(10, 'app.rack.request')
+      reused.native_stop_span(sp, 20)
+
+      spans = SpecHelper::Messages::Trace.decode(reused.native_serialize).spans
+      spans.should have(1).item
+      spans[0].duration.should == 10
+    end
+
+    it 'discounts GC time from native span times' do
+      native = Skylight::Trace.native_new(Util::Clock.new.native_ticks, "uuid")
+      discounted = native.native_now(1_000_000)
+      now = native.native_now(0)
+
+      # The two reads may fall either side of a 100us tick
+      discounted.should be_within(1).of(now - 10)
+    end
   end
 
 end
@@ -0,0 +1,42 @@
+require 'spec_helper'
+
+module Skylight::Util
+  describe Gzip::Stream do
+
+    def gunzip(str)
+      Zlib::GzipReader.new(StringIO.new(str)).read
+    end
+
+    let :body do
+      (0...50_000).map { |i| i.to_s(36) }.join(",")
+    end
+
+    let :stream do
+      Gzip::Stream.new(StringIO.new(body))
+    end
+
+    it "gzips the IO as it is read" do
+      gunzip(stream.read).should == body
+    end
+
+    it "reads in chunks like an IO" do
+      out = ''.force_encoding(Encoding::BINARY)
+      buf = ''
+
+      while stream.read(1000, buf)
+        buf.bytesize.should <= 1000
+        out << buf
+      end
+
+      gunzip(out).should == body
+    end
+
+    it "starts over when rewound" do
+      stream.read(1000)
+      stream.rewind.should == 0
+
+      gunzip(stream.read).should == body
+    end
+
+  end
+end
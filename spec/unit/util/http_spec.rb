@@ -66,4 +66,106 @@ module Skylight::Util
     end
 
   end
-end
\ No newline at end of file
+
+  describe HTTP, "connections" do
+
+    let :server do
+      SpecHelper::KeepAliveServer.new
+    end
+
+    let :deflate do
+      false
+    end
+
+    let :config do
+      Skylight::Config.new(report: { host: "127.0.0.1", port: server.port, ssl: false, deflate: deflate })
+    end
+
+    let :http do
+      HTTP.new(config, :report, keep_alive: 30)
+    end
+
+    before :each do
+      clock.freeze
+    end
+
+    after :each do
+      http.close
+      server.close
+    end
+
+    it "sends consecutive requests on one connection" do
+      http.get("/foo").should be_success
+      http.post("/report", "batch").should be_success
+
+      server.requests.map(&:path).should == ["/foo", "/report"]
+      server.connections.should == 1
+    end
+
+    it "reconnects once the connection has been idle too long" do
+      http.get("/foo")
+      clock.skip 29
+      http.get("/foo")
+      server.connections.should == 1
+
+      clock.skip 31
+      http.get("/foo").should be_success
+      server.connections.should == 2
+    end
+
+    it "retries a GET once when the server closed the kept alive connection" do
+      http.get("/warm")
+      server.drop_next
+
+      http.get("/foo").should be_success
+
+      server.requests.map(&:path).should == ["/warm", "/foo", "/foo"]
+      server.connections.should == 2
+    end
+
+    it "does not retry a POST when the server closed the kept alive connection" do
+      http.get("/warm")
+      server.drop_next
+
+      res = http.post("/report", "batch")
+      res.exception.should be_a(HTTP::ReadResponseError)
+
+      server.requests.map(&:path).should == ["/warm", "/report"]
+    end
+
+    it "streams an IO body with its Content-Length" do
+      body = "x" * 100_000
+      path = tmp("body")
+      path.write(body)
+
+      path.open("rb") { |io| http.post("/report", io).should be_success }
+
+      req = server.requests.last
+      req.headers["content-length"].should == "100000"
+      req.headers["transfer-encoding"].should be_nil
+      req.body.should == body
+    end
+
+    context "with deflate" do
+
+      let :deflate do
+        true
+      end
+
+      it "gzips an IO body as it is sent chunked" do
+        body = "x" * 100_000
+        path = tmp("body")
+        path.write(body)
+
+        path.open("rb") { |io| http.post("/report", io).should be_success }
+
+        req = server.requests.last
+        req.headers["transfer-encoding"].should == "chunked"
+        req.headers["content-encoding"].should == "gzip"
+        Zlib::GzipReader.new(StringIO.new(req.body)).read.should == body
+      end
+
+    end
+
+  end
+end
@@ -0,0 +1,36 @@
+require 'spec_helper'
+
+module Skylight::Util
+  describe Queue do
+    let :queue do
+      Queue.new(3)
+    end
+
+    it 'pushes until full' do
+      queue.push(1).should == 1
+      queue.push(2).should == 2
+      queue.push(3).should == 3
+      queue.push(4).should be_nil
+
+      queue.length.should == 3
+    end
+
+    it 'pops in order' do
+      3.times { |i| queue.push(i) }
+
+      queue.pop(0).should == 0
+      queue.pop(0).should == 1
+      queue.pop(0).should == 2
+      queue.pop(0).should be_nil
+    end
+
+    it 'drains up to the requested number of items' do
+      3.times { |i| queue.push(i) }
+
+      queue.drain(2).should == [0, 1]
+      queue.drain(2).should == [2]
+      queue.drain(2).should == []
+      queue.should be_empty
+    end
+  end
+end
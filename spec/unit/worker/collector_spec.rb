@@ -147,7 +147,7 @@ module Skylight
         req['HTTP_AUTHORIZATION'].should == token
       end unless strategy == :standalone
 
-      it 'continues the collector even if no session token can be obtained' do
+      it 'reports batches spooled while no session token could be obtained' do
         2.times do
           server.mock "/agent/authenticate" do |env|
             raise "nope"
@@ -156,19 +156,79 @@ module Skylight
 
         submit_trace
         clock.unfreeze
-        server.wait count: 3
+        server.wait count: 2, resource: "/agent/authenticate"
         clock.freeze
 
         mock_auth
 
         submit_trace
         clock.unfreeze
-        server.wait count: 5
+        server.wait count: 2, resource: "/report"
         clock.freeze
 
-        server.reports.should have(1).item
+        server.reports.should have(2).items
+        tmp.join("spool").children.should be_empty
       end unless strategy == :standalone
 
+      context "without a spool" do
+
+        let :config do
+          @config ||= Skylight::Config.new(test_config_values.merge(
+            agent: test_config_values[:agent].merge(spool_max_size: 0)
+          ))
+        end
+
+        it 'continues the collector even if no session token can be obtained' do
+          2.times do
+            server.mock "/agent/authenticate" do |env|
+              raise "nope"
+            end
+          end
+
+          submit_trace
+          clock.unfreeze
+          server.wait count: 3
+          clock.freeze
+
+          mock_auth
+
+          submit_trace
+          clock.unfreeze
+          server.wait count: 5
+          clock.freeze
+
+          server.reports.should have(1).item
+        end unless strategy == :standalone
+
+      end
+
+      context "with ingest shards" do
+
+        let :config do
+          @config ||= Skylight::Config.new(test_config_values.merge(
+            agent: test_config_values[:agent].merge(ingest_shards: 2)
+          ))
+        end
+
+        it 'submits the merged batch to the server' do
+          mock_auth
+
+          3.times { submit_trace }
+
+          clock.unfreeze
+          server.wait count: 1, resource: "/report"
+
+          batch = server.reports[0]
+          batch.should have(1).endpoints
+
+          ep = batch.endpoints[0]
+          ep.name.should == 'Unknown'
+          ep.count.should == 3
+          ep.should have(3).traces
+        end
+
+      end
+
       context "with crashing report server" do
 
         let :config do
@@ -211,4 +271,45 @@ module Skylight
     end unless defined?(JRUBY_VERSION)
 
   end
+
+  describe "Worker::Collector", "spool replay", :agent do
+
+    class CountingSpool
+      attr_reader :drains
+
+      def initialize
+        @drains = 0
+      end
+
+      def drain(now)
+        @drains += 1
+      end
+    end
+
+    let :config do
+      Skylight::Config.new(test_config_values.merge(
+        agent: test_config_values[:agent].merge(interval: 5),
+        test: { ignore_token: true }))
+    end
+
+    let :collector do
+      Worker::Collector.build(config).tap do |collector|
+        collector.instance_variable_set(:@refresh_at, 1 << 40)
+        collector.instance_variable_set(:@spool, spool)
+      end
+    end
+
+    let :spool do
+      CountingSpool.new
+    end
+
+    it 'replays one spooled batch per interval rather than per message' do
+      100.times { |i| collector.handle(nil, 1000 + i * 0.01) }
+      spool.drains.should == 1
+
+      collector.handle(nil, 1005)
+      spool.drains.should == 2
+    end
+
+  end
 end
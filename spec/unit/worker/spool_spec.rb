@@ -0,0 +1,83 @@
+require 'spec_helper'
+
+module Skylight
+  describe Worker::Spool do
+
+    let :config do
+      Skylight::Config.new(test_config_values)
+    end
+
+    let :path do
+      tmp("spool")
+    end
+
+    def spool(max_size = 1024)
+      Worker::Spool.new(config, path.to_s, max_size)
+    end
+
+    def drain_all(spool, now = 0)
+      batches = []
+      spool.drain(now) { |body, gzip| batches << [body.read, gzip] } until spool.empty?
+      batches
+    end
+
+    it 'drains batches in the order they were spooled' do
+      s = spool
+      s.push("foo", true).should be_true
+      s.push("bar", false).should be_true
+
+      s.length.should == 2
+      s.bytesize.should == 6
+
+      drain_all(s).should == [["foo", true], ["bar", false]]
+      path.children.should be_empty
+    end
+
+    it 'replays batches left by a previous spool' do
+      spool.push("foo", true)
+      spool.push("bar", true)
+
+      s = spool
+      s.length.should == 2
+      drain_all(s).map(&:first).should =~ ["foo", "bar"]
+    end
+
+    it 'drops the oldest batches once full' do
+      s = spool(8)
+      s.push("aaaa", true)
+      s.push("bbbb", true)
+      s.push("cccc", true)
+
+      s.bytesize.should == 8
+      drain_all(s).map(&:first).should == ["bbbb", "cccc"]
+    end
+
+    it 'rejects batches larger than the spool' do
+      spool(2).push("foo", true).should be_false
+    end
+
+    it 'backs off after a failed attempt' do
+      s = spool
+      s.push("foo", true)
+
+      attempts = 0
+      s.drain(100) { attempts += 1; false }
+      s.drain(101) { attempts += 1; false }
+      attempts.should == 1
+
+      s.drain(100 + Worker::Spool::MIN_BACKOFF) { attempts += 1; true }
+      attempts.should == 2
+      s.should be_empty
+    end
+
+    it 'ignores partially written batches' do
+      path.mkpath
+      path.join("0000000001-000001.gz.tmp").write("partial")
+
+      s = spool
+      s.should be_empty
+      path.children.should be_empty
+    end
+
+  end
+end
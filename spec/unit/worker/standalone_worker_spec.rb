@@ -139,6 +139,38 @@ describe 'Standalone worker', :agent do
 
   end
 
+  context 'ring IPC', :http do
+
+    let :config do
+      @config ||= Skylight::Config.new(test_config_values.merge(
+        agent: test_config_values[:agent].merge(ipc: 'ring')))
+    end
+
+    after :each do
+      Skylight.stop!
+    end
+
+    it 'passes traces to the agent through the ring' do
+      start!
+
+      worker = Skylight::Instrumenter.instance.instance_variable_get(:@worker)
+      ring = worker.instance_variable_get(:@ring)
+      ring.should_not be_nil
+      ring.should_receive(:native_push_trace).and_call_original
+
+      Skylight.trace 'Unknown', 'app.rack.request' do
+        clock.skip 0.01
+      end
+
+      server.wait count: 1, resource: "/report"
+      server.reports[0].endpoints[0].name.should == 'Unknown'
+
+      # The agent removes the ring's file once it has mapped it
+      Dir[sockfile_path("skylight-*.ring").to_s].should be_empty
+    end
+
+  end
+
   context 'reloading', :http, :agent do
 
     it 'reloads the agent when there is a new version' do